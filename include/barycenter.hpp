@@ -1,9 +1,16 @@
 #pragma once
 #include "power-diagram.hpp"
+#include "column-tuples.hpp"
+#include "solution-store.hpp"
+#include "solver-workspace.hpp"
+#include "sparse-plan.hpp"
+#include "transport-simplex.hpp"
 #include <glpk.h>
 #include <gsl/gsl_multiroots.h>
 
 class WassersteinBarycenter {
+  /* Microbenchmarks of the solver steps, see src/bench.cpp */
+  friend class BarycenterBenchmark;
 
 public:
   typedef std::vector<std::pair<K::Point_2, double>> discrete_dist;
@@ -13,7 +20,6 @@ private:
   enum shape { Polygon, Rectangle };
   std::vector<discrete_dist> marginals;
   int n_marginals;
-  PowerDiagram::vertex_with_data cell_area;
   std::vector<PowerDiagram::vertex> partition_vertices;
   void read_marginals_data(const char *filename, std::list<double> coefs);
   std::list<double> marginal_coefficients;
@@ -53,7 +59,12 @@ private:
       std::exit(EXIT_FAILURE);
     }
   }
-  bool is_uniform_measure = true;
+  /* Support measure: uniform, an analytic density integrated by quadrature
+   * or a raster density integrated by scanlines. */
+  enum measure { Uniform, Density, Raster };
+  measure support_measure = Uniform;
+  CellQuadrature quadrature;
+  RasterDensity raster;
   void extend_concave_potential();
 
   /* linear programming part */
@@ -61,17 +72,46 @@ private:
   void initialize_lp();
   int n_row_variables = 0;
   int n_column_variables = 1;
+  /* Tuples of points of the column variables, decoded on demand */
+  ColumnTuples columns;
   /* for objective function */
-  std::vector<double> squared_norm{0};
+  double squared_norm(int j) const {
+    double x, y;
+    columns.point(j, x, y);
+    return x * x + y * y;
+  }
   /* no zero entries in the constrain matrix */
   int n_entries;
   std::vector<int> dims;
-  std::unordered_set<int> dumb_column_variables;
-  /* default discrete plan is the independent plan */
-  std::vector<double> discrete_plan = {0};
+  /* Column variables of positive mass are the valid ones */
+  SparsePlan discrete_plan;
   void update_discrete_plan();
+  /* Plan of the last simplex, column_variable(k) being the column variable
+   * of column k of the LP */
+  template <class ColumnVariable>
+  void read_basic_plan(ColumnVariable column_variable);
   void reset_valid_colunm_variables();
   bool lp_solve_called = false;
+  /* Objective coefficient of a column variable */
+  double lp_cost(int j) const;
+  /* The same for the count column variables from first on */
+  void lp_costs(int first, int count, double *cost) const;
+  int lp_row(int m, int n) const;
+  /* Column generation: lp_columns[k] is the column variable of the k-th
+   * column of the restricted LP, counted from 1 */
+  std::vector<int> lp_columns{0};
+  std::vector<bool> is_lp_column;
+  /* Rows and coefficients of the column being added */
+  std::vector<int> lp_column_rows;
+  std::vector<double> lp_column_ones;
+  void add_lp_column(int j);
+  void initialize_lp_columns();
+  int price_lp_columns();
+  /* Two marginals: transportation problem kept from one step to the next */
+  TransportSimplex transport;
+  std::vector<double> lp_cost_matrix;
+  /* False if the network simplex reached its pivot limit */
+  bool update_transport_plan();
   void update_column_variables();
   void print_plan_support() {
     std::cout << "(";
@@ -83,28 +123,74 @@ private:
 
   /* Numerical solution */
   /* Semi discrete optimal transport solver */
+  /* Number of Newton iterations, or -1 when the solver gave up */
   int semi_discrete_iteration(int step);
-  gsl_multiroot_fdfsolver *semi_discrete_newton;
+  /* Whether the last semi-discrete solve reached the tolerance */
+  bool has_converged() const { return error < tolerance; }
+  int gsl_newton_iteration(int step);
+  int sparse_newton_iteration(int step);
+  bool solve_newton_step();
+  void restore_cells(const double *dx, int stride);
+  /* Multiscale initialization by coarser semi-discrete problems */
+  void cluster_column_variables(const std::vector<int> &variables, int m,
+                                std::vector<int> &representative);
+  void solve_coarse_levels(int step);
+  /* Approximate potential from an entropic transport problem */
+  void sinkhorn_potential();
+  /* Quasi-Newton ascent of the dual functional */
+  int lbfgs_iteration(int step);
+  double dual_value() const;
   void dump_semi_discrete_solver();
   struct semi_discrete_sol {
-    std::vector<double> discrete_plan;
+    SparsePlan discrete_plan;
     std::vector<double> potential;
     double error;
   };
   std::map<std::vector<int>, semi_discrete_sol> cached_semi_discrete_solution;
+  /* Solutions of previous runs of the same problem */
+  SolutionStore solution_store;
+  uint64_t problem_fingerprint() const;
+  void open_solution_store();
+  /* Converging alternative to the walk on LP vertices, with at most step
+   * Newton iterations per semi-discrete solve */
+  void frank_wolfe_iteration(unsigned int step);
+  /* Start from the cached solution whose valid column variables are the
+   * closest to the current ones, if any. */
+  bool warm_start_potential();
   void semi_discrete_solver(int step) {
+    semi_discrete_sol stored;
     if (cached_semi_discrete_solution.contains(valid_column_variables)) {
+      Trace::global().count(CacheHits);
       potential =
           cached_semi_discrete_solution[valid_column_variables].potential;
+    } else if (solution_store.find(valid_column_variables, tolerance,
+                                   stored.discrete_plan, stored.potential,
+                                   stored.error)) {
+      Trace::global().count(CacheHits);
+      potential = stored.potential;
+      error = stored.error;
+      cached_semi_discrete_solution.insert({valid_column_variables, stored});
     } else {
-      potential = std::vector<double>(n_column_variables + 1, 0);
+      Trace::global().count(CacheMisses);
+      if (not warm_start_potential()) {
+        potential = std::vector<double>(n_column_variables + 1, 0);
+        if (use_sinkhorn) {
+          sinkhorn_potential();
+        }
+      }
       semi_discrete_iteration(step);
       extend_concave_potential();
-      std::cout << "Cache lp vertex: ";
-      print_plan_support();
-      std::cout << "." << std::endl;
-      cached_semi_discrete_solution.insert(
-          {valid_column_variables, {discrete_plan, potential, error}});
+      /* An unconverged potential would be reused as is by later visits of
+       * the same vertex, so only keep the solved ones. */
+      if (has_converged()) {
+        std::cout << "Cache lp vertex: ";
+        print_plan_support();
+        std::cout << "." << std::endl;
+        cached_semi_discrete_solution.insert(
+            {valid_column_variables, {discrete_plan, potential, error}});
+        solution_store.append(valid_column_variables, discrete_plan, potential,
+                              error);
+      }
     }
   }
 
@@ -121,21 +207,119 @@ public:
 
   void saddle_point_iteration(unsigned int step, double tolerance = 10e-5);
 
-  std::vector<std::vector<int>> column_variables{{0}};
   std::vector<int> valid_column_variables;
 
   double support_area = 0;
-  std::vector<K::Point_2> support_points{K::Point_2(0, 0)};
+  /* Barycentric point of the tuple of column variable j */
+  K::Point_2 support_point(int j) const {
+    double x, y;
+    columns.point(j, x, y);
+    return K::Point_2(x, y);
+  }
   std::vector<double> potential;
   std::vector<double> gradient;
+  /* Mass of the support measure on each border of the partition, in the
+   * order of partition.neighbours, for non uniform measures. */
+  std::vector<double> border_masses;
+  void set_density(gsl_monte_function &f, int degree = 5) {
+    quadrature = CellQuadrature(f, degree);
+    support_measure = Density;
+  }
+  void set_density(batch_density f, void *params, int degree = 5) {
+    quadrature = CellQuadrature(f, params, degree);
+    support_measure = Density;
+  }
+  /* Pixels over the bounding box of the support, rows from bottom to top,
+   * normalized to a probability density on the support */
+  void set_raster_density(int n_columns, int n_rows,
+                          std::vector<double> pixels);
+  void read_raster_density(const char *filename);
+  bool has_uniform_measure() const { return support_measure == Uniform; }
+  /* Update the weights of the current partition in place instead of
+   * rebuilding it, whenever the sites are the same. */
+  bool incremental_partition = false;
+  /* Solve damped Newton steps by conjugate gradient on the sparse Jacobian,
+   * instead of the dense GSL multiroot solver. */
+  bool use_sparse_newton = true;
+  /* Apply the Jacobian matrix-free over the borders of the partition
+   * instead of assembling it, in the sparse Newton steps */
+  bool use_matrix_free = false;
+  /* Smallest fraction of a Newton step tried by the line search */
+  double min_newton_step = 1e-6;
+  /* Start each semi-discrete solve from the solutions of coarser problems,
+   * made of clusters of support points, each level about multiscale_ratio
+   * times smaller than the next one, down to multiscale_min_points. */
+  bool use_multiscale = false;
+  int multiscale_ratio = 4;
+  int multiscale_min_points = 100;
+  /* Number of L-BFGS iterations on the dual functional run before Newton in
+   * each semi-discrete solve, as a cheap first phase for the uniform
+   * measure, with the number of curvature pairs kept. */
+  int lbfgs_steps = 0;
+  int lbfgs_memory = 10;
+  /* Seed the semi-discrete solves that have no warm start with the dual
+   * potential of an entropic transport problem from a grid of about
+   * sinkhorn_points_per_cell samples per point of the support measure. The regularization is scaled by
+   * sinkhorn_scaling, with sinkhorn_iterations at each value, down to the
+   * squared grid step, from the squared diameter of the support or from
+   * sinkhorn_max_levels values above the last one. The grid has at most
+   * sinkhorn_max_samples squares. */
+  bool use_sinkhorn = false;
+  int sinkhorn_points_per_cell = 4;
+  int sinkhorn_iterations = 10;
+  double sinkhorn_scaling = 0.5;
+  int sinkhorn_max_samples = 16384;
+  int sinkhorn_max_levels = 8;
+  /* Start semi-discrete solves from the nearest cached LP vertex */
+  bool use_warm_start = true;
+  /* Move the plan towards each LP vertex by conditional gradient steps,
+   * until the duality gap is below frank_wolfe_tolerance or after
+   * frank_wolfe_steps of them, instead of walking on LP vertices until a
+   * loop appears. */
+  bool use_frank_wolfe = false;
+  unsigned int frank_wolfe_steps = 1000;
+  double frank_wolfe_tolerance = 1e-6;
+  /* With two marginals, solve the LP by a network simplex started from the
+   * basis of the previous step instead of GLPK */
+  bool use_network_simplex = true;
+  /* Solve a restricted LP holding only the column variables that entered it,
+   * adding those of negative reduced cost for the row duals, by batches of
+   * column_generation_batch, until there are none. It avoids building the
+   * constraint matrix over the product of the marginals. */
+  bool use_column_generation = false;
+  int column_generation_batch = 0;
+  double column_generation_tolerance = 1e-9;
+  /* Binary file keeping the semi-discrete solutions across runs, taken from
+   * the environment variable BARYCENTER_CACHE when empty. Disabled if both
+   * are empty. */
+  std::string solution_store_file;
   void update_partition_and_gradient();
+  /* Semi discrete transport cost of the current partition, from the moments
+   * accumulated while cropping. */
+  double transport_cost() const;
   double tolerance;
   double error = std::numeric_limits<double>::max();
 
+  /* Matrices, vectors and solvers of the semi-discrete iterations */
+  SolverWorkspace workspace;
+
   void dump_debug(bool exit_after_dump_debug = true);
 
-  ~WassersteinBarycenter() {
-    glp_delete_prob(lp);
-    gsl_multiroot_fdfsolver_free(semi_discrete_newton);
-  }
+  ~WassersteinBarycenter() { glp_delete_prob(lp); }
 };
+
+/* Jacobian of the gradient with respect to the potentials of the valid column
+ * variables, and the same without the last variable, as used by the solver. */
+int get_jacobian(WassersteinBarycenter *barycenter_problem, gsl_matrix *df);
+int get_jacobian_lower_dimension(WassersteinBarycenter *barycenter_problem,
+                                 gsl_matrix *J);
+/* Opposite of the Jacobian without the last variable, in sparse form */
+int get_sparse_jacobian(WassersteinBarycenter *barycenter_problem,
+                        SparseLaplacian &L);
+/* Same operator applied matrix-free, from its diagonal, on the threads of the
+ * partition */
+int get_jacobian_diagonal(WassersteinBarycenter *barycenter_problem,
+                          std::vector<double> &diagonal);
+void jacobian_product(WassersteinBarycenter *barycenter_problem,
+                      const std::vector<double> &diagonal,
+                      const std::vector<double> &x, std::vector<double> &y);
@@ -0,0 +1,28 @@
+#pragma once
+#include <vector>
+
+/* Vertex of a clipped polygon, labelled by the edge starting from it: the
+ * index of the neighbouring site, or -1 for an edge of the support. */
+struct clip_vertex {
+  double x;
+  double y;
+  int label;
+};
+
+/* Clip a convex polygon by half-planes a_x * x + a_y * y <= b.
+ * Both buffers are kept from one cell to the next, so that clipping does
+ * not allocate once they are large enough. */
+class ConvexClipper {
+  std::vector<clip_vertex> current;
+  std::vector<clip_vertex> next;
+
+public:
+  void reset(const std::vector<clip_vertex> &polygon) {
+    current.assign(polygon.begin(), polygon.end());
+  }
+  void clip(double a_x, double a_y, double b, int label);
+  /* Number of half-planes clipped so far */
+  long n_clips = 0;
+  bool is_empty() const { return current.size() < 3; }
+  const std::vector<clip_vertex> &vertices() const { return current; }
+};
@@ -0,0 +1,43 @@
+#pragma once
+#include <vector>
+
+/* Column variables j = 1, 2, ... are the tuples of one point per marginal,
+ * numbered in mixed radix over the sizes of the marginals with the first
+ * marginal varying fastest. Nothing is stored per tuple: its points and its
+ * barycentric point are decoded from j. The coordinates of the points of
+ * each marginal are kept as separate arrays of x and y, already weighted by
+ * the coefficient of the marginal in the barycenter. */
+class ColumnTuples {
+  std::vector<int> radix;
+  std::vector<long> strides{1};
+  /* Points of marginal m at x[offsets[m]] up to x[offsets[m + 1]] */
+  std::vector<int> offsets{0};
+  std::vector<double> x;
+  std::vector<double> y;
+
+public:
+  void clear() {
+    radix.clear();
+    strides.assign(1, 1);
+    offsets.assign(1, 0);
+    x.clear();
+    y.clear();
+  }
+  void add_marginal(const std::vector<double> &weighted_x,
+                    const std::vector<double> &weighted_y);
+
+  int number_of_marginals() const { return radix.size(); }
+  /* Number of column variables */
+  long size() const { return strides.back(); }
+  /* Index from 1 of the point of marginal m, from 0, in column variable j */
+  int digit(long j, int m) const { return (j - 1) / strides[m] % radix[m] + 1; }
+  std::vector<int> tuple(long j) const;
+  /* Column variable of the points of index n[m] from 0 */
+  long column(const std::vector<int> &n) const;
+
+  /* Barycentric point of column variable j */
+  void point(long j, double &p_x, double &p_y) const;
+  /* Barycentric points of the count column variables from first on, one run
+   * of the first marginal at a time, where only its own point changes. */
+  void points(long first, int count, double *p_x, double *p_y) const;
+};
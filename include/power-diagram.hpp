@@ -6,9 +6,16 @@
 #include <CGAL/Exact_predicates_inexact_constructions_kernel.h>
 #endif
 
+#include "clipping.hpp"
+#include "quadrature.hpp"
+#include "raster.hpp"
+#include "support-index.hpp"
+#include "trace.hpp"
 #include <CGAL/Polygon_2.h>
 #include <CGAL/Regular_triangulation_2.h>
+#include <CGAL/Triangulation_vertex_base_with_info_2.h>
 #include <gsl/gsl_monte.h>
+#include <iostream>
 
 #ifdef USE_EXACT_KERNEL
 typedef CGAL::Exact_predicates_exact_constructions_kernel K;
@@ -16,33 +23,43 @@ typedef CGAL::Exact_predicates_exact_constructions_kernel K;
 typedef CGAL::Exact_predicates_inexact_constructions_kernel K;
 #endif
 
-#ifdef USE_EXACT_KERNEL
-struct compSeg_2 {
-  bool operator()(const K::Segment_2 &s1, const K::Segment_2 &s2) const {
-    /* return s1.squared_length() < s2.squared_length(); */
-    if (s1.source() == s2.source()) {
-      return s1.target() < s2.target();
-    } else {
-      return s1.source() < s2.source();
-    }
+/* Mass, first and second moments of a cropped cell C, that is the integrals
+ * over C of 1, x, y, x^2, xy and y^2. */
+struct cell_moments {
+  double area = 0;
+  double x = 0;
+  double y = 0;
+  double xx = 0;
+  double xy = 0;
+  double yy = 0;
+
+  K::Point_2 centroid() const { return K::Point_2(x / area, y / area); }
+  /* Integral over C of the squared distance to p */
+  double squared_distance(const K::Point_2 &p) const {
+    const double p_x = CGAL::to_double(p.x());
+    const double p_y = CGAL::to_double(p.y());
+    return xx + yy - 2 * (p_x * x + p_y * y) + (p_x * p_x + p_y * p_y) * area;
   }
 };
-#endif
+cell_moments polygon_moments(const K::Point_2 *vertices, int n);
 
 class PowerDiagram {
-  typedef CGAL::Regular_triangulation_2<K> Regular_triangulation;
+  /* Vertices carry the index of their site */
+  typedef CGAL::Regular_triangulation_vertex_base_2<K> Vertex_base;
+  typedef CGAL::Triangulation_vertex_base_with_info_2<int, K, Vertex_base>
+      Vertex_base_with_index;
+  typedef CGAL::Regular_triangulation_face_base_2<K> Face_base;
+  typedef CGAL::Triangulation_data_structure_2<Vertex_base_with_index, Face_base>
+      Triangulation_data_structure;
+  typedef CGAL::Regular_triangulation_2<K, Triangulation_data_structure>
+      Regular_triangulation;
+  typedef Regular_triangulation::Vertex_handle Vertex_handle;
+  typedef Regular_triangulation::Face_handle Face_handle;
 
 public:
   typedef Regular_triangulation::Weighted_point vertex;
   typedef std::list<K::Point_2> chain;
   typedef CGAL::Polygon_2<K> polygon;
-#ifdef USE_EXACT_KERNEL
-  typedef std::map<vertex, double> vertex_with_data;
-  typedef std::map<vertex, std::string> vertex_with_label;
-#else
-  typedef std::unordered_map<vertex, double> vertex_with_data;
-  typedef std::unordered_map<vertex, std::string> vertex_with_label;
-#endif
 
 private:
   Regular_triangulation dual_rt;
@@ -50,8 +67,85 @@ private:
   void rotate_crop();
   void linear_crop();
 
+  /* Dual vertex of each finite face, and whether it lies in the support */
+  void update_dual(Face_handle f);
+  std::unordered_map<Face_handle, bool> is_inside;
+  bool face_is_inside(Face_handle f) const;
+
+  /* Cells and borders found by a cropping worker, assembled afterwards */
+  struct border_entry {
+    int i;
+    int j;
+    K::Segment_2 segment;
+    /* Length inside the support when it differs from the segment length,
+     * for a border cut into pieces by a non-convex support. */
+    double length = -1;
+  };
+  struct crop_buffer {
+    std::vector<int> cells;
+    std::vector<int> vertex_offsets{0};
+    std::vector<K::Point_2> vertices;
+    std::vector<border_entry> borders;
+    std::vector<cell_moments> moments;
+    /* Segment and half-plane intersection tests, for the trace */
+    long n_tests = 0;
+    ConvexClipper clipper;
+    SupportIndex::cut_buffer cut;
+  };
+  /* Close the cell made of the buffer vertices from first on */
+  void close_cell(crop_buffer &buffer, int index, int first);
+  /* Crop the cell of a single non-hidden vertex */
+  void crop_cell(Vertex_handle vh, crop_buffer &buffer);
+  /* Same for a convex support, by half-plane clipping */
+  void clip_cell(Vertex_handle vh, crop_buffer &buffer);
+  bool convex_support = false;
+  /* Clip by the power bisectors of vh with all its neighbours */
+  void clip_by_neighbours(Vertex_handle vh, ConvexClipper &clipper);
+  /* Same for a non-convex support, through the index of its edges */
+  void cut_cell(Vertex_handle vh, crop_buffer &buffer);
+  SupportIndex support_index;
+  std::vector<clip_vertex> support_box;
+  std::vector<clip_vertex> support_vertices;
+  void crop_cells(const std::vector<Vertex_handle> &cells,
+                  const std::vector<char> &recropped = {});
+  /* Rebuild the flat storage from the buffers, keeping the previous data
+   * of cells that are not recropped. */
+  void assemble(std::vector<crop_buffer> &buffers,
+                const std::vector<char> &recropped);
+  static constexpr int min_cells_per_thread = 64;
+
+  /* Sites are indexed in the order of insertion, which is the order of the
+   * column variables for a barycenter problem. The index of a site is the
+   * info of its vertex in the regular triangulation. */
+  std::vector<vertex> sites;
+  std::vector<Vertex_handle> site_handles;
+  void index_sites();
+  void triangulate();
+  int n_cells = 0;
+  /* Copy border values computed from the smaller index to the mirrored
+   * entries of the neighbours array. */
+  void mirror_borders(std::vector<double> &values) const;
+  /* Call f on each piece of the border k inside the support */
+  template <class F> void for_each_border_piece(int k, F f) const {
+    if (border_piece_offsets[k] == border_piece_offsets[k + 1]) {
+      f(borders[k]);
+      return;
+    }
+    for (int p = border_piece_offsets[k]; p < border_piece_offsets[k + 1];
+         p++) {
+      f(border_pieces[p]);
+    }
+  }
+  bool star_is_regular(Vertex_handle vh);
+  void collect_star(Vertex_handle vh, std::vector<char> &dirty);
+
 public:
   bool is_cropped = false;
+  /* Number of threads used to crop cells */
+  int n_threads = 1;
+  /* Crop cells by half-plane clipping, through an index of the support
+   * edges when the support is not convex */
+  bool use_clipping = true;
   /* Construction from regular triangulation */
   PowerDiagram(const char *data_filename) {
     std::ifstream in(data_filename);
@@ -62,25 +156,74 @@ public:
       wpoints.push_back({K::Point_2(x, y), w});
       in.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
     }
-    dual_rt = Regular_triangulation(wpoints.begin(), wpoints.end());
+    sites = wpoints;
+    triangulate();
   }
 
-#ifdef USE_EXACT_KERNEL
-  std::map<vertex, polygon> cropped_cells;
-#else
-  std::unordered_map<vertex, polygon> cropped_cells;
-#endif
-
-  PowerDiagram(Regular_triangulation &rt) { dual_rt = rt; };
+  PowerDiagram(Regular_triangulation &rt) {
+    dual_rt = rt;
+    for (auto vh : dual_rt.finite_vertex_handles()) {
+      vh->info() = sites.size();
+      sites.push_back(vh->point());
+    }
+    for (auto vit = dual_rt.hidden_vertices_begin();
+         vit != dual_rt.hidden_vertices_end(); ++vit) {
+      vit->info() = sites.size();
+      sites.push_back(vit->point());
+    }
+  };
 
   PowerDiagram(){};
 
   template <class InputIterator>
-  PowerDiagram(InputIterator first, InputIterator last) {
-    dual_rt = Regular_triangulation(first, last);
+  PowerDiagram(InputIterator first, InputIterator last) : sites(first, last) {
+    triangulate();
   };
 
-  void insert(vertex v) { dual_rt.insert(v); }
+  /* Replace the sites and triangulate them again, keeping the settings and
+   * the capacity of the buffers of the diagram */
+  template <class InputIterator>
+  void assign(InputIterator first, InputIterator last) {
+    sites.assign(first, last);
+    is_cropped = false;
+    triangulate();
+  }
+
+  void insert(vertex v) {
+    dual_rt.insert(v)->info() = sites.size();
+    sites.push_back(v);
+  }
+
+  /* Cropped cells addressed by site index: the vertices of cell i are
+   * cell_vertices[cell_offsets[i]] up to cell_vertices[cell_offsets[i + 1]]. */
+  std::vector<int> cell_offsets;
+  std::vector<K::Point_2> cell_vertices;
+  /* Borders as a CSR adjacency: the neighbours of site i, sorted by index, are
+   * neighbours[neighbour_offsets[i]] up to neighbours[neighbour_offsets[i + 1]],
+   * each with the shared border and its length. */
+  std::vector<int> neighbour_offsets;
+  std::vector<int> neighbours;
+  std::vector<K::Segment_2> borders;
+  std::vector<double> border_lengths;
+  /* A border cut into pieces by a non-convex support spans them all, and
+   * border k has the pieces border_pieces[border_piece_offsets[k]] up to
+   * border_pieces[border_piece_offsets[k + 1]], none if it is in one piece. */
+  std::vector<int> border_piece_offsets{0};
+  std::vector<K::Segment_2> border_pieces;
+  /* Accumulated while cropping */
+  std::vector<cell_moments> moments;
+
+  int number_of_sites() const { return sites.size(); }
+  const vertex &site(int i) const { return sites[i]; }
+  int number_of_cells() const { return n_cells; }
+  int number_of_borders() const { return neighbours.size() / 2; }
+  bool has_cell(int i) const {
+    return cell_offsets[i + 1] - cell_offsets[i] > 2;
+  }
+  polygon cell(int i) const {
+    return polygon(cell_vertices.begin() + cell_offsets[i],
+                   cell_vertices.begin() + cell_offsets[i + 1]);
+  }
 
   std::unordered_map<Regular_triangulation::Face_handle, K::Point_2> vertex_of_face;
 
@@ -100,9 +243,51 @@ public:
 
   void crop(polygon support_polygon) {
     cropped_shape = support_polygon;
+    cell_offsets.assign(sites.size() + 1, 0);
+    cell_vertices.clear();
+    neighbour_offsets.assign(sites.size() + 1, 0);
+    neighbours.clear();
+    borders.clear();
+    border_lengths.clear();
+    border_piece_offsets.assign(1, 0);
+    border_pieces.clear();
+    moments.assign(sites.size(), cell_moments());
+    n_cells = 0;
+    /* Clipping works with double coordinates */
+#ifdef USE_EXACT_KERNEL
+    convex_support = false;
+    /* The rotation only follows supports that cut each border once, and
+     * the index of the support edges works with double coordinates. */
+    if (not support_polygon.is_convex()) {
+      std::cerr << "Non-convex supports are not handled with the exact "
+                   "kernel."
+                << std::endl;
+      std::exit(EXIT_FAILURE);
+    }
+#else
+    convex_support = use_clipping && support_polygon.is_convex();
+#endif
+    support_vertices.clear();
+    for (auto p : support_polygon.vertices()) {
+      support_vertices.push_back(
+          {CGAL::to_double(p.x()), CGAL::to_double(p.y()), -1});
+    }
+    if (support_polygon.is_clockwise_oriented()) {
+      std::reverse(support_vertices.begin(), support_vertices.end());
+    }
+    support_index = SupportIndex();
+#ifndef USE_EXACT_KERNEL
+    if (use_clipping && not convex_support) {
+      support_index.build(support_vertices);
+      support_box = support_index.box(0.01);
+    }
+#endif
+    vertex_of_face.clear();
+    is_inside.clear();
+    index_sites();
     /* delay the calculation of dual until now */
     for (auto f : dual_rt.finite_face_handles()) {
-      vertex_of_face.insert({f, dual_rt.dual(f)});
+      update_dual(f);
     }
 
     if (not dual_rt.is_valid())
@@ -113,20 +298,26 @@ public:
       linear_crop();
   }
 
-  /* For integration */
-  vertex_with_data area();
-  vertex_with_data integral(gsl_monte_function &f);
+  /* Change the weights of already inserted sites, keeping the regular
+   * triangulation alive. Only the cells whose neighbourhood changed are
+   * cropped again. Returns the number of re-cropped cells, or -1 if the
+   * diagram should be rebuilt from scratch instead. */
+  int update_weights(const std::vector<vertex> &vertices);
 
-#ifdef USE_EXACT_KERNEL
-  std::map<K::Segment_2, K::Segment_2, compSeg_2> borders;
-#else
-  std::unordered_map<K::Segment_2, K::Segment_2> borders;
-#endif
+  /* For integration, addressed by site index */
+  std::vector<double> area();
+  std::vector<double> integral(gsl_monte_function &f);
+  std::vector<double> integral(CellQuadrature &quadrature) const;
+  std::vector<double> integral(const RasterDensity &density) const;
+  /* Line integrals along the borders, in the order of the neighbours array */
+  std::vector<double> border_integral(CellQuadrature &quadrature) const;
+  std::vector<double> border_integral(const RasterDensity &density) const;
 
   /* Draw power diagram through different interfaces. */
   void plot_mma();
   bool use_label = false;
-  vertex_with_label label;
+  /* Labels addressed by site index */
+  std::vector<std::string> labels;
   bool gnuplot();
 
   /* Access some info from the regular triangulation. */
@@ -0,0 +1,60 @@
+#pragma once
+#include <gsl/gsl_monte.h>
+#include <vector>
+
+/* Density evaluated at once on n points stored as x_0, y_0, x_1, y_1, ...
+ * Evaluating a whole batch lets the density loop be vectorized. */
+typedef void (*batch_density)(const double *points, size_t n, double *values,
+                              void *params);
+
+/* Deterministic integration of a density over triangles and segments.
+ * Triangles use symmetric rules of degree 5 (7 nodes) or 8 (16 nodes), and
+ * segments Gauss-Legendre rules of degree 5 (3 nodes) or 9 (5 nodes).
+ * Nodes are queued first and the density is evaluated on all of them in a
+ * single batch by integrate(). Without a density, the measure is uniform. */
+class CellQuadrature {
+  gsl_monte_function *pointwise = nullptr;
+  batch_density batch = nullptr;
+  void *params = nullptr;
+
+  /* Barycentric coordinates and weights of the rules, weights summing to 1 */
+  std::vector<double> triangle_nodes;
+  std::vector<double> triangle_weights;
+  std::vector<double> segment_nodes;
+  std::vector<double> segment_weights;
+  void set_degree(int degree);
+
+  /* Queued nodes and weights, the nodes of the k-th integral being in
+   * [offsets[k], offsets[k + 1]). */
+  std::vector<double> points;
+  std::vector<double> weights;
+  std::vector<double> values;
+  std::vector<int> offsets{0};
+  std::vector<double> results;
+
+public:
+  explicit CellQuadrature(int degree = 5) { set_degree(degree); }
+  CellQuadrature(gsl_monte_function &f, int degree = 5) : pointwise(&f) {
+    set_degree(degree);
+  }
+  CellQuadrature(batch_density f, void *params, int degree = 5)
+      : batch(f), params(params) {
+    set_degree(degree);
+  }
+  bool is_uniform() const { return pointwise == nullptr && batch == nullptr; }
+
+  /* Add a triangle or a segment to the current integral. A clockwise
+   * triangle counts negatively. */
+  void add_triangle(double a_x, double a_y, double b_x, double b_y, double c_x,
+                    double c_y);
+  void add_segment(double a_x, double a_y, double b_x, double b_y);
+  /* Close the current integral and return its index */
+  int next() {
+    offsets.push_back(weights.size());
+    return offsets.size() - 2;
+  }
+
+  /* Evaluate the density on all queued nodes and return the integrals in
+   * the order of next() calls. The queue is emptied. */
+  const std::vector<double> &integrate();
+};
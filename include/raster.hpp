@@ -0,0 +1,44 @@
+#pragma once
+#include <array>
+#include <vector>
+
+/* Piecewise constant density on a grid of n_columns x n_rows pixels over
+ * the box [x_min, x_max] x [y_min, y_max], rows stored from bottom to top.
+ * Each row keeps its prefix sums, so that the mass of a polygon is computed
+ * exactly along its boundary, in time proportional to the number of pixels
+ * its edges cross rather than the number of pixels it covers. */
+class RasterDensity {
+  double x_min, y_min, x_max, y_max;
+  int n_columns, n_rows;
+  double dx, dy;
+  std::vector<double> pixels;
+  /* prefix[j * (n_columns + 1) + i] is the integral of row j over the
+   * first i columns, per unit of height. */
+  std::vector<double> prefix;
+
+  /* Integral of row j from x_min to x, per unit of height */
+  double row_integral(int j, double x) const;
+  static void add_grid_crossings(std::vector<double> &breaks, double a,
+                                 double u, double origin, double step, int n);
+
+public:
+  RasterDensity() : RasterDensity(0, 0, 1, 1, 1, 1, {1}) {}
+  /* The density is normalized to a probability density over the box */
+  RasterDensity(double x_min, double y_min, double x_max, double y_max,
+                int n_columns, int n_rows, std::vector<double> values);
+  /* Scale the density to a unit mass over a polygon inside the box, given
+   * as for polygon_mass, such as a support which does not fill the box */
+  void normalize(const double *xy, int n);
+
+  double value(double x, double y) const;
+  const std::vector<double> &pixel_values() const { return pixels; }
+  int columns() const { return n_columns; }
+  int rows() const { return n_rows; }
+  /* Box covered by the pixels, as x_min, y_min, x_max, y_max */
+  std::array<double, 4> extent() const { return {x_min, y_min, x_max, y_max}; }
+  /* Mass of a polygon given by coordinates x_0, y_0, x_1, y_1, ..., which
+   * may be concave or made of rings joined by cuts of zero width */
+  double polygon_mass(const double *xy, int n) const;
+  /* Line integral of the density along a segment */
+  double segment_mass(double a_x, double a_y, double b_x, double b_y) const;
+};
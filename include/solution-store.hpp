@@ -0,0 +1,63 @@
+#pragma once
+#include "sparse-plan.hpp"
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+/* FNV-1a hash of the data defining a barycenter problem */
+class Fingerprint {
+  uint64_t hash = 14695981039346656037ull;
+
+public:
+  void add(const void *data, size_t size) {
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    for (size_t k = 0; k < size; k++) {
+      hash = (hash ^ bytes[k]) * 1099511628211ull;
+    }
+  }
+  void add(double x) { add(&x, sizeof(x)); }
+  void add(int64_t k) { add(&k, sizeof(k)); }
+  uint64_t value() const { return hash; }
+};
+
+/* Semi-discrete solutions kept in a binary file across runs. The file is
+ * mapped read-only when opened and indexed by the valid column variables of
+ * the records of the given problem, new solutions are appended to it. A
+ * record is the problem fingerprint, the number of valid column variables,
+ * the number of values of the potential, the error, the variables, the mass
+ * of the plan on each of them and the potential. */
+class SolutionStore {
+  const char *data = nullptr;
+  size_t data_size = 0;
+  std::map<std::vector<int>, size_t> offsets;
+  int fd = -1;
+  std::vector<char> record;
+  uint64_t fingerprint = 0;
+  int n_values = 0;
+
+  void unmap();
+  void close();
+  bool index(const std::string &filename);
+
+public:
+  SolutionStore() = default;
+  SolutionStore(const SolutionStore &) = delete;
+  SolutionStore &operator=(const SolutionStore &) = delete;
+  ~SolutionStore() { close(); }
+
+  /* Returns false if the file cannot be opened, is not a solution store or
+   * has a corrupted record. The file is locked while it is indexed and while
+   * a record is appended, so that several runs can share it. */
+  bool open(const std::string &filename, uint64_t fingerprint, int n_values);
+  bool is_open() const { return fd >= 0; }
+  /* Number of records of the problem found when opening */
+  int size() const { return offsets.size(); }
+  /* Returns false if there is no record of these columns solved with an
+   * error below max_error */
+  bool find(const std::vector<int> &columns, double max_error,
+            SparsePlan &plan, std::vector<double> &potential,
+            double &error) const;
+  void append(const std::vector<int> &columns, const SparsePlan &plan,
+              const std::vector<double> &potential, double error);
+};
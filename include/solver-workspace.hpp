@@ -0,0 +1,41 @@
+#pragma once
+#include "sparse-laplacian.hpp"
+#include "worker-pool.hpp"
+#include <gsl/gsl_matrix.h>
+#include <gsl/gsl_multiroots.h>
+#include <gsl/gsl_vector.h>
+
+/* Storage of the semi-discrete solvers, kept from one solve to the next and
+ * grown to the largest active set, so that long saddle point iterations do
+ * not go through the allocator at every step. */
+class SolverWorkspace {
+  gsl_block *jacobian_block = nullptr;
+  gsl_matrix *jacobian_matrix = nullptr;
+  gsl_vector *potential_vector = nullptr;
+  gsl_multiroot_fdfsolver *solver = nullptr;
+
+public:
+  SolverWorkspace() = default;
+  SolverWorkspace(const SolverWorkspace &) = delete;
+  SolverWorkspace &operator=(const SolverWorkspace &) = delete;
+  ~SolverWorkspace();
+
+  /* Dense n x n matrix over storage of the largest size requested so far */
+  gsl_matrix *dense_jacobian(int n);
+  gsl_vector *gsl_potential(int n);
+  /* GSL Newton solver of dimension n, reallocated when n changes */
+  gsl_multiroot_fdfsolver *newton_solver(int n);
+
+  /* Sparse Newton steps */
+  SparseLaplacian sparse_jacobian;
+  std::vector<double> diagonal;
+  cg_buffer cg;
+  std::vector<double> residual;
+  std::vector<double> direction;
+  std::vector<double> potential;
+  /* Threads of the matrix-free Jacobian products */
+  WorkerPool workers;
+
+  /* Bytes held by the workspace */
+  size_t memory_footprint() const;
+};
@@ -0,0 +1,124 @@
+#pragma once
+#include <cmath>
+#include <vector>
+
+/* Buffers of the conjugate gradient, kept from one solve to the next */
+struct cg_buffer {
+  std::vector<double> residual;
+  std::vector<double> preconditioned;
+  std::vector<double> direction;
+  std::vector<double> image;
+};
+
+/* Conjugate gradient for a symmetric positive definite operator, applied by
+ * multiply(x, y) as y = A x, with the diagonal of A as preconditioner. It
+ * starts from the initial guess in x, and stops when the residual norm is
+ * below tolerance times the norm of b. Returns the number of iterations, or
+ * -1 if it did not converge. */
+template <class Multiply>
+int conjugate_gradient(Multiply multiply, const std::vector<double> &diagonal,
+                       const std::vector<double> &b, std::vector<double> &x,
+                       cg_buffer &buffer, double tolerance = 1e-10,
+                       int max_iterations = 0) {
+  const int n = diagonal.size();
+  if (max_iterations <= 0) {
+    max_iterations = 10 * n + 100;
+  }
+  for (int i = 0; i < n; i++) {
+    if (not(diagonal[i] > 0)) {
+      return -1;
+    }
+  }
+  x.resize(n, 0);
+
+  auto &r = buffer.residual;
+  auto &z = buffer.preconditioned;
+  auto &p = buffer.direction;
+  auto &q = buffer.image;
+  auto dot = [n](const std::vector<double> &u, const std::vector<double> &v) {
+    double sum = 0;
+    for (int i = 0; i < n; i++) {
+      sum += u[i] * v[i];
+    }
+    return sum;
+  };
+  const double threshold = tolerance * std::sqrt(dot(b, b));
+
+  q.resize(n);
+  multiply(x, q);
+  r.resize(n);
+  z.resize(n);
+  for (int i = 0; i < n; i++) {
+    r[i] = b[i] - q[i];
+    z[i] = r[i] / diagonal[i];
+  }
+  p = z;
+  double rho = dot(r, z);
+
+  for (int iteration = 0; iteration < max_iterations; iteration++) {
+    if (std::sqrt(dot(r, r)) <= threshold) {
+      return iteration;
+    }
+    multiply(p, q);
+    const double curvature = dot(p, q);
+    if (not(curvature > 0)) {
+      return -1;
+    }
+    const double alpha = rho / curvature;
+    for (int i = 0; i < n; i++) {
+      x[i] += alpha * p[i];
+      r[i] -= alpha * q[i];
+      z[i] = r[i] / diagonal[i];
+    }
+    const double next_rho = dot(r, z);
+    const double beta = next_rho / rho;
+    rho = next_rho;
+    for (int i = 0; i < n; i++) {
+      p[i] = z[i] + beta * p[i];
+    }
+  }
+  return std::sqrt(dot(r, r)) <= threshold ? max_iterations : -1;
+}
+
+/* Symmetric positive definite matrix in CSR form, such as the opposite of
+ * the Jacobian of the semi-discrete gradient once one potential is fixed:
+ * the off-diagonal entries of row i are values[offsets[i]] up to
+ * values[offsets[i + 1]], in the columns given by the same range of
+ * columns. */
+class SparseLaplacian {
+  cg_buffer buffer;
+
+public:
+  std::vector<double> diagonal;
+  std::vector<int> offsets{0};
+  std::vector<int> columns;
+  std::vector<double> values;
+
+  int size() const { return diagonal.size(); }
+  void clear() {
+    diagonal.clear();
+    offsets.assign(1, 0);
+    columns.clear();
+    values.clear();
+  }
+  /* Rows are added in order, by their off-diagonal entries first */
+  void add_entry(int j, double value) {
+    columns.push_back(j);
+    values.push_back(value);
+  }
+  void close_row(double d) {
+    diagonal.push_back(d);
+    offsets.push_back(columns.size());
+  }
+
+  void multiply(const std::vector<double> &x, std::vector<double> &y) const;
+  /* Conjugate gradient with a diagonal preconditioner, see above */
+  int solve(const std::vector<double> &b, std::vector<double> &x,
+            double tolerance = 1e-10, int max_iterations = 0) {
+    return conjugate_gradient(
+        [this](const std::vector<double> &u, std::vector<double> &v) {
+          multiply(u, v);
+        },
+        diagonal, b, x, buffer, tolerance, max_iterations);
+  }
+};
@@ -0,0 +1,40 @@
+#pragma once
+#include <utility>
+#include <vector>
+
+/* Discrete plan stored on its support only, that is the column variables of
+ * nonzero mass in increasing order. A basic solution of the LP has at most
+ * as many of them as rows. */
+class SparsePlan {
+  std::vector<int> columns;
+  std::vector<double> masses;
+
+public:
+  bool empty() const { return columns.empty(); }
+  int size() const { return columns.size(); }
+  void clear() {
+    columns.clear();
+    masses.clear();
+  }
+  /* Column variables are added in increasing order, zero masses are skipped */
+  void push_back(int j, double mass) {
+    if (mass != 0) {
+      columns.push_back(j);
+      masses.push_back(mass);
+    }
+  }
+  /* The same from pairs of column variables and masses in any order */
+  void assign(std::vector<std::pair<int, double>> &entries);
+  const std::vector<int> &support() const { return columns; }
+  int column(int k) const { return columns[k]; }
+  double mass(int k) const { return masses[k]; }
+
+  /* Mass of column variable j, zero out of the support */
+  double operator[](int j) const;
+  /* Add to the mass of a column variable of the support */
+  void add(int j, double mass);
+
+  /* s a + t b, on the union of the supports */
+  static SparsePlan combination(double s, const SparsePlan &a, double t,
+                                const SparsePlan &b);
+};
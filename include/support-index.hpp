@@ -0,0 +1,67 @@
+#pragma once
+#include "clipping.hpp"
+#include <vector>
+
+/* Edges of a (possibly non-convex) support polygon, bucketed in a uniform
+ * grid of about one edge per grid cell, so that the edges near a power cell
+ * are found without scanning the whole support. */
+class SupportIndex {
+  /* Counterclockwise support, edge e going from vertex e to vertex e + 1 */
+  std::vector<clip_vertex> support;
+  double x_min = 0, y_min = 0, x_max = 0, y_max = 0;
+  double width = 1, height = 1;
+  int n_x = 0, n_y = 0;
+  /* Edges overlapping the grid cell (c_x, c_y) are the entries of
+   * cell_edges from cell_offsets[c_y * n_x + c_x] on. */
+  std::vector<int> cell_offsets;
+  std::vector<int> cell_edges;
+
+  int column(double x) const;
+  int row(double y) const;
+
+public:
+  /* Crossing of a support edge with a side of the convex polygon, at
+   * positions t along the edge and s along the side */
+  struct crossing {
+    int edge;
+    int side;
+    double t;
+    double s;
+    double x;
+    double y;
+    bool enters_convex;
+    bool enters_support;
+  };
+  struct piece {
+    int from;
+    int to;
+    double x;
+    double y;
+    int label;
+  };
+  /* Buffers kept by each cropping thread from one cell to the next */
+  struct cut_buffer {
+    std::vector<int> edges;
+    std::vector<crossing> crossings;
+    /* Crossings of the n-th edge, from first_crossing[n] on */
+    std::vector<int> first_crossing;
+    std::vector<int> order;
+    std::vector<piece> pieces;
+    std::vector<char> used;
+    /* Rings of the intersection, vertices being labelled as by the
+     * ConvexClipper, from ring_offsets[r] to ring_offsets[r + 1]. */
+    std::vector<clip_vertex> vertices;
+    std::vector<int> ring_offsets;
+  };
+
+  void build(const std::vector<clip_vertex> &polygon);
+  bool is_empty() const { return support.empty(); }
+  /* Bounding box of the support, counterclockwise */
+  std::vector<clip_vertex> box(double margin) const;
+  bool contains(double x, double y) const;
+  /* Intersect the support with a convex counterclockwise polygon, whose
+   * vertices are labelled by the edge starting from them. Edges of the
+   * result on the support are labelled -1. */
+  void intersect(const std::vector<clip_vertex> &convex,
+                 cut_buffer &buffer) const;
+};
@@ -0,0 +1,84 @@
+#pragma once
+#include <chrono>
+#include <fstream>
+#include <initializer_list>
+#include <utility>
+
+/* Timers and counters of the solver phases, written as one JSON object per
+ * line when the environment variable BARYCENTER_TRACE names a file. Inner
+ * lines (Newton iterations) report what happened since the previous inner
+ * line, outer lines (LP vertices) since the previous outer line. Timers and
+ * counters are only touched from the calling thread, workers report their
+ * counts once joined. */
+enum trace_phase {
+  Triangulation,
+  Crop,
+  Area,
+  Integration,
+  Jacobian,
+  LinearSolve,
+  Simplex,
+  n_trace_phases
+};
+enum trace_counter {
+  Rebuilds,
+  IncrementalUpdates,
+  IntersectionTests,
+  NewtonIterations,
+  CacheHits,
+  CacheMisses,
+  n_trace_counters
+};
+enum trace_level { Inner, Outer };
+
+class Trace {
+  std::ofstream file;
+  bool enabled = false;
+  std::chrono::steady_clock::time_point start;
+  double seconds[2][n_trace_phases] = {};
+  long counts[2][n_trace_counters] = {};
+
+  Trace();
+
+public:
+  static Trace &global();
+  bool is_enabled() const { return enabled; }
+  void add_time(trace_phase phase, double s) {
+    seconds[Inner][phase] += s;
+    seconds[Outer][phase] += s;
+  }
+  void count(trace_counter counter, long k = 1) {
+    counts[Inner][counter] += k;
+    counts[Outer][counter] += k;
+  }
+  /* Write the event with its fields, then the phase times and counters of
+   * the level, which are reset. */
+  void write(trace_level level, const char *event,
+             std::initializer_list<std::pair<const char *, double>> fields);
+};
+
+/* Adds its lifetime to a phase, nothing when tracing is off */
+class scoped_timer {
+  trace_phase phase;
+  bool enabled;
+  std::chrono::steady_clock::time_point start;
+
+public:
+  scoped_timer(trace_phase phase)
+      : phase(phase), enabled(Trace::global().is_enabled()) {
+    if (enabled) {
+      start = std::chrono::steady_clock::now();
+    }
+  }
+  ~scoped_timer() { stop(); }
+  /* End the phase before the end of the scope */
+  void stop() {
+    if (enabled) {
+      Trace::global().add_time(
+          phase, std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - start)
+                     .count());
+      enabled = false;
+    }
+  }
+};
@@ -0,0 +1,49 @@
+#pragma once
+#include <vector>
+
+/* Network simplex for the transportation problem between supplies a_i and
+ * demands b_j of equal total, minimizing the sum of cost[i * n + j] times the
+ * flow from i to j. The basis is a spanning tree of the m + n nodes made of
+ * m + n - 1 arcs, kept between solves: once the costs change, the next solve
+ * starts from the previous optimal basis, which is still feasible. */
+class TransportSimplex {
+  struct arc {
+    int row;
+    int column;
+    double flow;
+  };
+  int m = 0;
+  int n = 0;
+  std::vector<arc> basis;
+  /* Tree rooted at row 0, columns being the nodes m up to m + n - 1 */
+  std::vector<int> parent;
+  std::vector<int> parent_arc;
+  std::vector<int> depth;
+  std::vector<double> node_potential;
+  std::vector<std::vector<int>> incident;
+  std::vector<int> queue;
+  std::vector<int> cycle;
+  std::vector<int> branch;
+  /* Cell where the block pricing resumes */
+  long next_cell = 0;
+
+  void build_tree(const std::vector<double> &cost);
+  void hang(int top, int above, int arc, const std::vector<double> &cost);
+  bool pivot(int i, int j, const std::vector<double> &cost);
+
+public:
+  /* Start from the basis of the north-west corner rule */
+  void reset(const std::vector<double> &supply,
+             const std::vector<double> &demand);
+  bool is_initialized() const { return not basis.empty(); }
+  int rows() const { return m; }
+  int columns() const { return n; }
+  /* Returns the number of pivots, or -1 if the iteration limit is reached */
+  int solve(const std::vector<double> &cost, double tolerance = 1e-12);
+  /* Flows of the basic arcs, the others are zero */
+  template <class Callback> void for_each_flow(Callback callback) const {
+    for (const auto &a : basis) {
+      callback(a.row, a.column, a.flow);
+    }
+  }
+};
@@ -0,0 +1,34 @@
+#pragma once
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Threads started once and kept between parallel loops, for loops too short
+ * to pay for creating and joining threads every time, such as the products
+ * of the conjugate gradient. */
+class WorkerPool {
+  std::vector<std::thread> threads;
+  std::mutex mutex;
+  std::condition_variable start;
+  std::condition_variable done;
+  /* Loop body of the current run, owned by the caller of run */
+  const std::function<void(int)> *task = nullptr;
+  int n_active = 0;
+  int pending = 0;
+  long generation = 0;
+  bool stopping = false;
+
+  void loop(int worker, long seen);
+
+public:
+  WorkerPool() = default;
+  WorkerPool(const WorkerPool &) = delete;
+  WorkerPool &operator=(const WorkerPool &) = delete;
+  ~WorkerPool();
+
+  /* Run task(w) for w from 0 to n_workers - 1 and wait for all of them, the
+   * calling thread running task(0). Threads are added as needed. */
+  void run(int n_workers, const std::function<void(int)> &task);
+};
@@ -0,0 +1,262 @@
+#include "barycenter.hpp"
+#include "power-diagram.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <gsl/gsl_linalg.h>
+#include <new>
+#include <random>
+
+/* Microbenchmarks of the geometry and solver kernels on seeded synthetic
+ * workloads: n uniform random sites in the unit square, which is also the
+ * support. Each kernel is repeated until it has run for some time, and the
+ * fastest run is reported per cell, with the heap allocations it made.
+ *
+ * Usage: bench [max_sites] [seed] [threads] */
+
+static std::atomic<long> n_allocations{0};
+static std::atomic<long> allocated_bytes{0};
+
+void *operator new(std::size_t size) {
+  n_allocations.fetch_add(1, std::memory_order_relaxed);
+  allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+  if (void *p = std::malloc(size ? size : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+/* Dense Jacobians take n^2 doubles, and a Newton step n^3 operations */
+constexpr int max_dense_sites = 4000;
+/* Sinkhorn iterations go over all the pairs of samples and sites */
+constexpr int max_sinkhorn_sites = 2000;
+constexpr double min_total_seconds = 0.5;
+constexpr int max_repetitions = 100;
+
+/* Silence the progress messages of the solver while it is measured */
+class quiet_cout {
+  std::streambuf *buffer;
+
+public:
+  quiet_cout() : buffer(std::cout.rdbuf(nullptr)) {}
+  ~quiet_cout() {
+    std::cout.rdbuf(buffer);
+    std::cout.clear();
+  }
+};
+
+template <class Setup, class Run>
+void measure(const char *kernel, int n, Setup setup, Run run) {
+  double best = std::numeric_limits<double>::max();
+  double total = 0;
+  long allocations = 0;
+  long bytes = 0;
+  int repetitions = 0;
+  while (repetitions < max_repetitions &&
+         (repetitions == 0 || total < min_total_seconds)) {
+    {
+      quiet_cout quiet;
+      setup();
+    }
+    const long allocations_before = n_allocations.load();
+    const long bytes_before = allocated_bytes.load();
+    const auto start = std::chrono::steady_clock::now();
+    {
+      quiet_cout quiet;
+      run();
+    }
+    const double seconds = std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() - start)
+                               .count();
+    allocations = n_allocations.load() - allocations_before;
+    bytes = allocated_bytes.load() - bytes_before;
+    best = std::min(best, seconds);
+    total += seconds;
+    repetitions++;
+  }
+  std::printf("%-22s %8i %6i %14.1f %12.2f %14.1f\n", kernel, n, repetitions,
+              1e9 * best / n, double(allocations) / n, double(bytes) / n);
+}
+
+void skip(const char *kernel, int n) {
+  std::printf("%-22s %8i %6s %14s %12s %14s\n", kernel, n, "-", "skipped", "-",
+              "-");
+}
+
+std::vector<PowerDiagram::vertex> random_sites(int n, std::mt19937 &rng) {
+  std::uniform_real_distribution<double> coordinate(0, 1);
+  std::uniform_real_distribution<double> weight(0, 0.1 / std::sqrt(n));
+  std::vector<PowerDiagram::vertex> sites;
+  sites.reserve(n);
+  for (int i = 0; i < n; i++) {
+    const double x = coordinate(rng);
+    const double y = coordinate(rng);
+    sites.push_back({K::Point_2(x, y), weight(rng)});
+  }
+  return sites;
+}
+
+/* A single discrete marginal, that is a semi-discrete transport problem
+ * from the uniform measure of the unit square to n random points. */
+void write_marginals(const char *filename, int n, std::mt19937 &rng) {
+  std::uniform_real_distribution<double> coordinate(0, 1);
+  std::ofstream file(filename);
+  file.precision(17);
+  for (int i = 0; i < n; i++) {
+    const double x = coordinate(rng);
+    const double y = coordinate(rng);
+    file << x << "\t" << y << "\t" << 1.0 / n << std::endl;
+  }
+  file << std::endl;
+}
+
+/* Drives the private steps of the solver */
+class BarycenterBenchmark {
+  WassersteinBarycenter &problem;
+
+public:
+  BarycenterBenchmark(WassersteinBarycenter &problem) : problem(problem) {}
+
+  void initialize_lp() { problem.initialize_lp(); }
+  void update_discrete_plan() {
+    problem.update_discrete_plan();
+    problem.update_column_variables();
+  }
+  /* Start from the Voronoi diagram of the support points */
+  void reset_potential() {
+    problem.potential.assign(problem.n_column_variables + 1, 0);
+    problem.gradient.assign(problem.n_column_variables + 1, 0);
+    problem.update_partition_and_gradient();
+  }
+  void sinkhorn_potential() { problem.sinkhorn_potential(); }
+  /* One step of the sparse solver, from the evaluation of the gradient */
+  void sparse_newton_step() { problem.sparse_newton_iteration(1); }
+  /* Same update as one iteration of the GSL Newton solver */
+  void newton_step(gsl_matrix *jacobian, gsl_vector *f, gsl_vector *dx,
+                   gsl_permutation *permutation) {
+    const auto &variables = problem.valid_column_variables;
+    const int n = f->size;
+    get_jacobian_lower_dimension(&problem, jacobian);
+    for (int i = 0; i < n; i++) {
+      gsl_vector_set(f, i, problem.gradient[variables[i]]);
+    }
+    int sign;
+    gsl_linalg_LU_decomp(jacobian, permutation, &sign);
+    gsl_linalg_LU_solve(jacobian, permutation, f, dx);
+    for (int i = 0; i < n; i++) {
+      problem.potential[variables[i]] -= gsl_vector_get(dx, i);
+    }
+    problem.update_partition_and_gradient();
+  }
+};
+
+void bench_power_diagram(int n, unsigned seed, int n_threads) {
+  std::mt19937 rng(seed + n);
+  const auto sites = random_sites(n, rng);
+  const K::Iso_rectangle_2 bbox{0, 0, 1, 1};
+
+  PowerDiagram pd;
+  measure(
+      "construction", n, [] {},
+      [&] { pd = PowerDiagram(sites.begin(), sites.end()); });
+  pd.n_threads = n_threads;
+  measure("crop (clipping)", n, [] {}, [&] { pd.crop(bbox); });
+  pd.use_clipping = false;
+  measure("crop (rotation)", n, [] {}, [&] { pd.crop(bbox); });
+  pd.use_clipping = true;
+  pd.crop(bbox);
+  std::vector<double> areas;
+  measure("area", n, [] {}, [&] { areas = pd.area(); });
+}
+
+void bench_solver(int n, unsigned seed, int n_threads) {
+  std::mt19937 rng(seed + n);
+  const auto filename =
+      std::filesystem::temp_directory_path() / "bench-marginals";
+  write_marginals(filename.c_str(), n, rng);
+
+  std::unique_ptr<WassersteinBarycenter> problem;
+  auto new_problem = [&] {
+    problem = std::make_unique<WassersteinBarycenter>(
+        K::Iso_rectangle_2{0, 0, 1, 1}, filename.c_str());
+    problem->partition.n_threads = n_threads;
+    problem->tolerance = 10e-10;
+  };
+  measure("initialize_lp", n, new_problem,
+          [&] { BarycenterBenchmark(*problem).initialize_lp(); });
+  measure("update_discrete_plan", n, [] {},
+          [&] { BarycenterBenchmark(*problem).update_discrete_plan(); });
+
+  BarycenterBenchmark solver(*problem);
+  {
+    quiet_cout quiet;
+    solver.reset_potential();
+  }
+  SparseLaplacian sparse_jacobian;
+  measure("get_sparse_jacobian", n, [] {},
+          [&] { get_sparse_jacobian(problem.get(), sparse_jacobian); });
+  measure(
+      "sparse newton step", n, [&] { solver.reset_potential(); },
+      [&] { solver.sparse_newton_step(); });
+  problem->use_matrix_free = true;
+  measure(
+      "matrix-free newton", n, [&] { solver.reset_potential(); },
+      [&] { solver.sparse_newton_step(); });
+  problem->use_matrix_free = false;
+  if (n > max_sinkhorn_sites) {
+    skip("sinkhorn seed", n);
+  } else {
+    measure(
+        "sinkhorn seed", n, [&] { solver.reset_potential(); },
+        [&] { solver.sinkhorn_potential(); });
+  }
+  {
+    quiet_cout quiet;
+    solver.reset_potential();
+  }
+
+  if (n > max_dense_sites) {
+    skip("get_jacobian", n);
+    skip("newton step", n);
+    std::filesystem::remove(filename);
+    return;
+  }
+
+  gsl_matrix *jacobian = gsl_matrix_alloc(n, n);
+  measure("get_jacobian", n, [] {},
+          [&] { get_jacobian(problem.get(), jacobian); });
+  gsl_matrix_free(jacobian);
+
+  gsl_matrix *lower_jacobian = gsl_matrix_alloc(n - 1, n - 1);
+  gsl_vector *f = gsl_vector_alloc(n - 1);
+  gsl_vector *dx = gsl_vector_alloc(n - 1);
+  gsl_permutation *permutation = gsl_permutation_alloc(n - 1);
+  measure(
+      "newton step", n, [&] { solver.reset_potential(); },
+      [&] { solver.newton_step(lower_jacobian, f, dx, permutation); });
+  gsl_permutation_free(permutation);
+  gsl_vector_free(dx);
+  gsl_vector_free(f);
+  gsl_matrix_free(lower_jacobian);
+  std::filesystem::remove(filename);
+}
+
+int main(int argc, char *argv[]) {
+  const int max_sites = argc > 1 ? std::stoi(argv[1]) : 100000;
+  const unsigned seed = argc > 2 ? std::stoul(argv[2]) : 1;
+  const int n_threads = argc > 3 ? std::stoi(argv[3]) : 1;
+
+  std::printf("Seed %u, %i cropping threads.\n", seed, n_threads);
+  std::printf("%-22s %8s %6s %14s %12s %14s\n", "Kernel", "Sites", "Runs",
+              "ns/cell", "allocs/cell", "bytes/cell");
+  /* Half decades from 10^2 sites on */
+  for (double size = 100; std::lround(size) <= max_sites;
+       size *= std::sqrt(10.0)) {
+    const int n = std::lround(size);
+    bench_power_diagram(n, seed, n_threads);
+    bench_solver(n, seed, n_threads);
+  }
+}
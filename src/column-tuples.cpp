@@ -0,0 +1,68 @@
+#include "column-tuples.hpp"
+#include <algorithm>
+
+void ColumnTuples::add_marginal(const std::vector<double> &weighted_x,
+                                const std::vector<double> &weighted_y) {
+  radix.push_back(weighted_x.size());
+  strides.push_back(strides.back() * long(weighted_x.size()));
+  x.insert(x.end(), weighted_x.begin(), weighted_x.end());
+  y.insert(y.end(), weighted_y.begin(), weighted_y.end());
+  offsets.push_back(x.size());
+}
+
+std::vector<int> ColumnTuples::tuple(long j) const {
+  std::vector<int> n(radix.size());
+  for (int m = 0; m < radix.size(); m++) {
+    n[m] = digit(j, m);
+  }
+  return n;
+}
+
+long ColumnTuples::column(const std::vector<int> &n) const {
+  long j = 1;
+  for (int m = 0; m < radix.size(); m++) {
+    j += n[m] * strides[m];
+  }
+  return j;
+}
+
+void ColumnTuples::point(long j, double &p_x, double &p_y) const {
+  p_x = 0;
+  p_y = 0;
+  long rest = j - 1;
+  for (int m = 0; m < radix.size(); m++) {
+    const int k = offsets[m] + rest % radix[m];
+    rest /= radix[m];
+    p_x += x[k];
+    p_y += y[k];
+  }
+}
+
+void ColumnTuples::points(long first, int count, double *p_x,
+                          double *p_y) const {
+  if (radix.empty()) {
+    return;
+  }
+  const int run = radix[0];
+  const double *x_0 = x.data();
+  const double *y_0 = y.data();
+  long j = first;
+  int done = 0;
+  while (done < count) {
+    /* The other marginals are fixed along the run */
+    double rest_x, rest_y;
+    point(j, rest_x, rest_y);
+    const int start = (j - 1) % run;
+    rest_x -= x_0[start];
+    rest_y -= y_0[start];
+    const int length = std::min(run - start, count - done);
+    double *out_x = p_x + done;
+    double *out_y = p_y + done;
+    for (int i = 0; i < length; i++) {
+      out_x[i] = x_0[start + i] + rest_x;
+      out_y[i] = y_0[start + i] + rest_y;
+    }
+    j += length;
+    done += length;
+  }
+}
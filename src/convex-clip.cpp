@@ -0,0 +1,125 @@
+#include "power-diagram.hpp"
+
+void ConvexClipper::clip(double a_x, double a_y, double b, int label) {
+  n_clips++;
+  const int n = current.size();
+  if (n == 0) {
+    return;
+  }
+  auto value = [&](const clip_vertex &p) { return a_x * p.x + a_y * p.y - b; };
+  auto crossing = [](const clip_vertex &p, const clip_vertex &q, double d_p,
+                     double d_q, int l) {
+    const double t = d_p / (d_p - d_q);
+    return clip_vertex{p.x + t * (q.x - p.x), p.y + t * (q.y - p.y), l};
+  };
+
+  next.clear();
+  double d_p = value(current[0]);
+  for (int k = 0; k < n; k++) {
+    const clip_vertex &p = current[k];
+    const clip_vertex &q = current[k + 1 < n ? k + 1 : 0];
+    const double d_q = value(q);
+    if (d_p < 0) {
+      next.push_back(p);
+      if (d_q > 0) {
+        /* Leaving the half-plane, the next edge is on the clipping line */
+        next.push_back(crossing(p, q, d_p, d_q, label));
+      }
+    } else if (d_p == 0) {
+      next.push_back({p.x, p.y, d_q > 0 ? label : p.label});
+    } else if (d_q < 0) {
+      /* Entering the half-plane */
+      next.push_back(crossing(p, q, d_p, d_q, p.label));
+    }
+    d_p = d_q;
+  }
+  std::swap(current, next);
+}
+
+void PowerDiagram::clip_by_neighbours(Vertex_handle vh,
+                                      ConvexClipper &clipper) {
+  const double v_x = CGAL::to_double(vh->point().x());
+  const double v_y = CGAL::to_double(vh->point().y());
+  const double v_power = v_x * v_x + v_y * v_y - vh->point().weight();
+  auto vc = dual_rt.incident_vertices(vh);
+  auto done = vc;
+  do {
+    if (not dual_rt.is_infinite(vc)) {
+      const double u_x = CGAL::to_double(vc->point().x());
+      const double u_y = CGAL::to_double(vc->point().y());
+      const double u_power = u_x * u_x + u_y * u_y - vc->point().weight();
+      clipper.clip(2 * (u_x - v_x), 2 * (u_y - v_y), u_power - v_power,
+                   vc->info());
+    }
+  } while (++vc != done && not clipper.is_empty());
+}
+
+/* For a convex support, a cell is the support clipped by the half-planes
+ * of the power bisectors with its neighbours. Cells whose dual vertices are
+ * all inside the support need no clipping at all. */
+void PowerDiagram::clip_cell(Vertex_handle vh, crop_buffer &buffer) {
+  const int index = vh->info();
+  const int first = buffer.vertices.size();
+
+  auto fc = dual_rt.incident_faces(vh);
+  while (dual_rt.is_infinite(fc)) {
+    ++fc;
+  }
+  const Face_handle f = fc;
+  /* Next face counterclockwise around vh, and the shared neighbour */
+  auto next_face = [&](Face_handle g) {
+    return g->neighbor(Regular_triangulation::ccw(g->index(vh)));
+  };
+  auto next_vertex = [&](Face_handle g) {
+    return g->vertex(Regular_triangulation::cw(g->index(vh)));
+  };
+
+  bool is_interior = true;
+  Face_handle current_f = f;
+  do {
+    if (dual_rt.is_infinite(current_f) || not face_is_inside(current_f)) {
+      is_interior = false;
+      break;
+    }
+    current_f = next_face(current_f);
+  } while (current_f != f);
+
+  if (is_interior) {
+    current_f = f;
+    do {
+      const Face_handle next_f = next_face(current_f);
+      const K::Point_2 &p = vertex_of_face.at(current_f);
+      const K::Point_2 &q = vertex_of_face.at(next_f);
+      if (buffer.vertices.size() == first || buffer.vertices.back() != p) {
+        buffer.vertices.push_back(p);
+      }
+      if (p != q) {
+        buffer.borders.push_back(
+            {index, next_vertex(current_f)->info(), {p, q}});
+      }
+      current_f = next_f;
+    } while (current_f != f);
+  } else {
+    auto &clipper = buffer.clipper;
+    clipper.reset(support_vertices);
+    clip_by_neighbours(vh, clipper);
+
+    if (not clipper.is_empty()) {
+      const auto &clipped = clipper.vertices();
+      const int n = clipped.size();
+      for (int k = 0; k < n; k++) {
+        const K::Point_2 p(clipped[k].x, clipped[k].y);
+        const clip_vertex &next = clipped[k + 1 < n ? k + 1 : 0];
+        const K::Point_2 q(next.x, next.y);
+        if (buffer.vertices.size() == first || buffer.vertices.back() != p) {
+          buffer.vertices.push_back(p);
+        }
+        if (clipped[k].label >= 0 && p != q) {
+          buffer.borders.push_back({index, clipped[k].label, {p, q}});
+        }
+      }
+    }
+  }
+
+  close_cell(buffer, index, first);
+}
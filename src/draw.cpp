@@ -6,17 +6,19 @@ void PowerDiagram::plot_mma() {
               << std::endl;
   } else {
     std::cout << "Graphics[{";
-    for (auto cell : cropped_cells) {
-      auto poly = cell.second;
+    for (int i = 0; i < sites.size(); i++) {
+      if (not has_cell(i)) {
+        continue;
+      }
+      auto poly = cell(i);
       for (auto eit = poly.edges_begin(); eit != poly.edges_end(); ++eit) {
         auto e = *eit;
         std::cout << "Line[{{" << (e.start()).x() << ", " << (e.start()).y()
                   << "}, {" << (e.end()).x() << ", " << (e.end()).y()
                   << "}}], ";
       }
-      std::cout << "Circle[{" << cell.first.point().x() << ", "
-                << cell.first.point().y() << "}, " << cell.first.weight()
-                << "]";
+      std::cout << "Circle[{" << sites[i].point().x() << ", "
+                << sites[i].point().y() << "}, " << sites[i].weight() << "]";
     }
     std::cout << "}]" << std::endl;
   }
@@ -30,21 +32,23 @@ bool PowerDiagram::gnuplot() {
     std::ofstream line("data/pd_lines");
     std::ofstream point("data/pd_points");
     std::list<polygon> polygon_to_draw{};
-    if (cropped_cells.size() == 0) {
+    if (number_of_cells() == 0) {
       std::cout << "No cells found. Fail to plot." << std::endl;
       return false;
     }
-    double min_radius = CGAL::to_double(cropped_cells.begin()->first.weight());
-    for (auto cell : cropped_cells) {
-      if (cell.first.weight() < min_radius) {
-        min_radius = CGAL::to_double(cell.first.weight());
+    double min_radius = std::numeric_limits<double>::max();
+    for (int i = 0; i < sites.size(); i++) {
+      if (has_cell(i) && sites[i].weight() < min_radius) {
+        min_radius = CGAL::to_double(sites[i].weight());
       }
     }
-    for (auto cell : cropped_cells) {
-      auto poly = cell.second;
-      point << cell.first.point() << " "
-            << cell.first.weight() - min_radius + 0.0001 << " "
-            << label[cell.first] << std::endl;
+    for (int i = 0; i < sites.size(); i++) {
+      if (not has_cell(i)) {
+        continue;
+      }
+      auto poly = cell(i);
+      point << sites[i].point() << " " << sites[i].weight() - min_radius + 0.0001
+            << " " << (i < labels.size() ? labels[i] : "") << std::endl;
       for (auto eit = poly.edges_begin(); eit != poly.edges_end(); ++eit) {
         line << eit->source() << " " << eit->to_vector() << std::endl;
       }
@@ -0,0 +1,105 @@
+#include <barycenter.hpp>
+
+/* Conditional gradient on the plans. The objective, a convex function of the
+ * discrete plan, has the LP costs of the extended potential as gradient, so
+ * the LP vertex of the current potential minimizes its linearization. The
+ * plan moves towards this vertex by the step 2 / (k + 2) instead of jumping
+ * to it, which converges without detecting loops of LP vertices. The
+ * linearization at the vertex bounds the gap to the optimal value. */
+void WassersteinBarycenter::frank_wolfe_iteration(unsigned int steps) {
+  /* Shortest step tried towards a vertex when the semi-discrete problem of
+   * the plan cannot be solved */
+  constexpr double min_step = 1e-6;
+  potential = std::vector<double>(n_column_variables + 1, 0);
+  gradient = std::vector<double>(n_column_variables + 1, 0);
+  update_discrete_plan();
+  SparsePlan plan = discrete_plan;
+  /* Last plan whose semi-discrete problem is solved, with its potential */
+  SparsePlan solved_plan = plan;
+  std::vector<double> solved_potential = potential;
+  std::vector<int> previous_support = plan.support();
+  SparsePlan vertex = plan;
+
+  double gap = std::numeric_limits<double>::max();
+  double step = 0;
+  unsigned int k = 0;
+  for (; k < frank_wolfe_steps; k++) {
+    /* The plan is not an LP vertex, so its semi-discrete solution is not
+     * cached, but the previous potential is a close start. Newly active
+     * variables get a weight increment of the order of their mass to start
+     * with a cell. As long as the semi-discrete problem cannot be solved, the
+     * plan moves a shorter way from the last solved plan, whose cells are
+     * all large enough, so that the new variables get smaller masses. Only
+     * accepted steps count. */
+    bool solved = false;
+    while (true) {
+      discrete_plan = plan;
+      update_column_variables();
+      for (int j : valid_column_variables) {
+        if (not std::binary_search(previous_support.begin(),
+                                   previous_support.end(), j)) {
+          potential[j] += discrete_plan[j] * support_area;
+        }
+      }
+      const int iter = semi_discrete_iteration(steps);
+      if (iter >= 0 && has_converged()) {
+        solved = true;
+        break;
+      }
+      potential = solved_potential;
+      step /= 2;
+      if (step < min_step) {
+        break;
+      }
+      std::cout << "Shorten the conditional gradient step to " << step << "."
+                << std::endl;
+      plan = SparsePlan::combination(1 - step, solved_plan, step, vertex);
+    }
+    if (not solved) {
+      std::cout << "The semi-discrete problem of the plan cannot be solved "
+                   "after "
+                << k << " conditional gradient steps." << std::endl;
+      break;
+    }
+    previous_support = valid_column_variables;
+    extend_concave_potential();
+    solved_plan = plan;
+    solved_potential = potential;
+
+    update_discrete_plan();
+    vertex = discrete_plan;
+    const SparsePlan direction = SparsePlan::combination(1, plan, -1, vertex);
+    gap = 0;
+    for (int i = 0; i < direction.size(); i++) {
+      gap += lp_cost(direction.column(i)) * direction.mass(i);
+    }
+    Trace::global().write(Outer, "frank_wolfe",
+                          {{"iteration", k + 1},
+                           {"valid_variables", valid_column_variables.size()},
+                           {"gap", gap},
+                           {"step", step},
+                           {"error", error}});
+    if (gap < frank_wolfe_tolerance) {
+      break;
+    }
+    step = 2.0 / (k + 2);
+    plan = SparsePlan::combination(1 - step, plan, step, vertex);
+  }
+
+  discrete_plan = solved_plan;
+  potential = solved_potential;
+  update_column_variables();
+  std::cout << std::endl;
+  if (gap < frank_wolfe_tolerance) {
+    std::cout << "We reach the solution after " << k + 1
+              << " conditional gradient steps, with gap " << gap
+              << " and error " << error << "." << std::endl;
+    update_partition_and_gradient();
+    print_info();
+    partition.gnuplot();
+  } else {
+    std::cout << "Finish the program after " << k
+              << " conditional gradient steps, with gap " << gap
+              << ", the barycenter is not found yet." << std::endl;
+  }
+}
@@ -0,0 +1,161 @@
+#include "power-diagram.hpp"
+
+void PowerDiagram::triangulate() {
+  scoped_timer timer(Triangulation);
+  Trace::global().count(Rebuilds);
+  std::vector<std::pair<vertex, int>> indexed_sites;
+  indexed_sites.reserve(sites.size());
+  for (int k = 0; k < sites.size(); k++) {
+    indexed_sites.push_back({sites[k], k});
+  }
+  dual_rt.clear();
+  dual_rt.insert(indexed_sites.begin(), indexed_sites.end());
+}
+
+void PowerDiagram::index_sites() {
+  site_handles.assign(sites.size(), Vertex_handle());
+  for (auto vh : dual_rt.finite_vertex_handles()) {
+    site_handles[vh->info()] = vh;
+  }
+  for (auto vit = dual_rt.hidden_vertices_begin();
+       vit != dual_rt.hidden_vertices_end(); ++vit) {
+    site_handles[vit->info()] = vit;
+  }
+}
+
+/* A weight change only affects the power tests involving the vertex itself,
+ * i.e. the edges of its incident faces and the vertices hidden in them. */
+bool PowerDiagram::star_is_regular(Vertex_handle vh) {
+  auto fc = dual_rt.incident_faces(vh);
+  auto done = fc;
+  do {
+    Face_handle f = fc;
+    for (int j = 0; j < 3; j++) {
+      auto mirror = dual_rt.mirror_vertex(f, j);
+      if (not dual_rt.is_infinite(mirror) &&
+          dual_rt.power_test(f, mirror->point()) == CGAL::ON_POSITIVE_SIDE) {
+        return false;
+      }
+    }
+    for (auto hidden : f->vertex_list()) {
+      if (dual_rt.power_test(f, hidden->point()) == CGAL::ON_POSITIVE_SIDE) {
+        return false;
+      }
+    }
+  } while (++fc != done);
+  return true;
+}
+
+/* Mark the neighbours of vh and the vertices hidden around it as dirty, and
+ * forget the dual data of its incident faces. */
+void PowerDiagram::collect_star(Vertex_handle vh, std::vector<char> &dirty) {
+  auto fc = dual_rt.incident_faces(vh);
+  auto done = fc;
+  do {
+    Face_handle f = fc;
+    for (int j = 0; j < 3; j++) {
+      auto u = f->vertex(j);
+      if (not dual_rt.is_infinite(u)) {
+        dirty[u->info()] = true;
+      }
+    }
+    for (auto hidden : f->vertex_list()) {
+      dirty[hidden->info()] = true;
+    }
+    vertex_of_face.erase(f);
+    is_inside.erase(f);
+  } while (++fc != done);
+}
+
+int PowerDiagram::update_weights(const std::vector<vertex> &vertices) {
+  const int n = sites.size();
+  if (not is_cropped || dual_rt.dimension() != 2 || vertices.size() != n) {
+    return -1;
+  }
+  for (int k = 0; k < n; k++) {
+    if (vertices[k].point() != sites[k].point()) {
+      return -1;
+    }
+  }
+
+  scoped_timer timer(Triangulation);
+  Trace::global().count(IncrementalUpdates);
+  std::vector<char> dirty(n, false);
+  for (int k = 0; k < n; k++) {
+    const vertex &v = vertices[k];
+    Vertex_handle vh = site_handles[k];
+    if (sites[k].weight() == v.weight()) {
+      continue;
+    }
+
+    dirty[k] = true;
+    if (not vh->is_hidden()) {
+      /* Try to change the weight in place */
+      vh->set_point(v);
+      if (star_is_regular(vh)) {
+        sites[k] = v;
+        collect_star(vh, dirty);
+        continue;
+      }
+      vh->set_point(sites[k]);
+      collect_star(vh, dirty);
+    }
+
+    /* The combinatorial structure changes around this vertex */
+    Face_handle hint = vh->face();
+    Vertex_handle neighbour = Vertex_handle();
+    if (not vh->is_hidden()) {
+      auto vc = dual_rt.incident_vertices(vh);
+      while (dual_rt.is_infinite(vc)) {
+        ++vc;
+      }
+      neighbour = vc;
+    }
+    dual_rt.remove(vh);
+    if (neighbour != Vertex_handle()) {
+      hint = neighbour->face();
+    }
+    vh = dual_rt.insert(v, hint);
+    if (vh == Vertex_handle() || dual_rt.dimension() != 2) {
+      return -1;
+    }
+    vh->info() = k;
+    sites[k] = v;
+    site_handles[k] = vh;
+    if (not vh->is_hidden()) {
+      collect_star(vh, dirty);
+    }
+  }
+
+  /* Handles of vertices hidden or revealed by the updates should be kept by
+   * the triangulation, but check it before any further use. */
+  for (int k = 0; k < n; k++) {
+    if (dirty[k] && site_handles[k]->point() != sites[k]) {
+      return -1;
+    }
+  }
+
+  std::vector<Vertex_handle> cells;
+  for (int k = 0; k < n; k++) {
+    Vertex_handle vh = site_handles[k];
+    if (not dirty[k] || vh->is_hidden()) {
+      continue;
+    }
+    cells.push_back(vh);
+    auto fc = dual_rt.incident_faces(vh);
+    auto done = fc;
+    do {
+      Face_handle f = fc;
+      if (dual_rt.is_infinite(f)) {
+        is_inside[f] = false;
+      } else {
+        update_dual(f);
+      }
+    } while (++fc != done);
+  }
+
+  /* Borders of dirty cells are computed again while cropping */
+  timer.stop();
+  crop_cells(cells, dirty);
+  return cells.size();
+}
@@ -1,21 +1,196 @@
 #include "power-diagram.hpp"
 #include <gsl/gsl_math.h>
-#include <gsl/gsl_monte_miser.h>
 
-PowerDiagram::vertex_with_data PowerDiagram::area() {
-  vertex_with_data area;
+cell_moments polygon_moments(const K::Point_2 *vertices, int n) {
+  /* Sum over edges in coordinates relative to the first vertex, for
+   * accuracy, and translate back afterwards. */
+  const double r_x = CGAL::to_double(vertices[0].x());
+  const double r_y = CGAL::to_double(vertices[0].y());
+  cell_moments m;
+  double p_x = 0;
+  double p_y = 0;
+  for (int k = 1; k <= n; k++) {
+    const auto &q = vertices[k < n ? k : 0];
+    const double q_x = CGAL::to_double(q.x()) - r_x;
+    const double q_y = CGAL::to_double(q.y()) - r_y;
+    const double cross = p_x * q_y - q_x * p_y;
+    m.area += cross;
+    m.x += (p_x + q_x) * cross;
+    m.y += (p_y + q_y) * cross;
+    m.xx += (p_x * p_x + p_x * q_x + q_x * q_x) * cross;
+    m.yy += (p_y * p_y + p_y * q_y + q_y * q_y) * cross;
+    m.xy += (p_x * q_y + 2 * p_x * p_y + 2 * q_x * q_y + q_x * p_y) * cross;
+    p_x = q_x;
+    p_y = q_y;
+  }
+  m.area /= 2;
+  m.x /= 6;
+  m.y /= 6;
+  m.xx /= 12;
+  m.yy /= 12;
+  m.xy /= 24;
+
+  m.xx += 2 * r_x * m.x + r_x * r_x * m.area;
+  m.yy += 2 * r_y * m.y + r_y * r_y * m.area;
+  m.xy += r_x * m.y + r_y * m.x + r_x * r_y * m.area;
+  m.x += r_x * m.area;
+  m.y += r_y * m.area;
+  return m;
+}
+
+std::vector<double> PowerDiagram::area() {
+  scoped_timer timer(Area);
+  std::vector<double> area(sites.size(), 0);
   if (not is_cropped) {
     std::cerr << "Power diagram not cropped, please use crop method fisrt."
               << std::endl;
   } else {
-    for (auto cc : cropped_cells) {
-      area.insert({cc.first, CGAL::to_double(cc.second.area())});
+    for (int i = 0; i < sites.size(); i++) {
+      area[i] = moments[i].area;
     }
   }
   return area;
 }
 
-PowerDiagram::vertex_with_data PowerDiagram::integral(gsl_monte_function &f) {
-  vertex_with_data integral;
+std::vector<double> PowerDiagram::integral(gsl_monte_function &f) {
+  CellQuadrature quadrature(f);
+  return integral(quadrature);
+}
+
+std::vector<double> PowerDiagram::integral(CellQuadrature &quadrature) const {
+  scoped_timer timer(Integration);
+  std::vector<double> integral(sites.size(), 0);
+  if (not is_cropped) {
+    std::cerr << "Power diagram not cropped, please use crop method fisrt."
+              << std::endl;
+    return integral;
+  }
+
+  /* Triangulate the cells as fans from their first vertex. Triangles are
+   * signed, so this holds for the concave cells of a non-convex support, and
+   * the cuts of zero width joining the rings of a cell cancel out. */
+  std::vector<int> cell_of_integral;
+  for (int i = 0; i < sites.size(); i++) {
+    const int first = cell_offsets[i];
+    const int n = cell_offsets[i + 1] - first;
+    if (n < 3) {
+      continue;
+    }
+    const K::Point_2 *v = &cell_vertices[first];
+    const double a_x = CGAL::to_double(v[0].x());
+    const double a_y = CGAL::to_double(v[0].y());
+    for (int k = 1; k + 1 < n; k++) {
+      quadrature.add_triangle(
+          a_x, a_y, CGAL::to_double(v[k].x()), CGAL::to_double(v[k].y()),
+          CGAL::to_double(v[k + 1].x()), CGAL::to_double(v[k + 1].y()));
+    }
+    quadrature.next();
+    cell_of_integral.push_back(i);
+  }
+
+  const auto &results = quadrature.integrate();
+  for (int k = 0; k < cell_of_integral.size(); k++) {
+    integral[cell_of_integral[k]] = results[k];
+  }
   return integral;
-};
+}
+
+std::vector<double>
+PowerDiagram::border_integral(CellQuadrature &quadrature) const {
+  scoped_timer timer(Integration);
+  std::vector<double> integral(neighbours.size(), 0);
+  if (not is_cropped) {
+    std::cerr << "Power diagram not cropped, please use crop method fisrt."
+              << std::endl;
+    return integral;
+  }
+
+  /* Each border is stored twice, integrate it once from its smaller index */
+  std::vector<int> border_of_integral;
+  for (int i = 0; i < sites.size(); i++) {
+    for (int k = neighbour_offsets[i]; k < neighbour_offsets[i + 1]; k++) {
+      if (neighbours[k] < i) {
+        continue;
+      }
+      for_each_border_piece(k, [&quadrature](const K::Segment_2 &s) {
+        quadrature.add_segment(
+            CGAL::to_double(s.source().x()), CGAL::to_double(s.source().y()),
+            CGAL::to_double(s.target().x()), CGAL::to_double(s.target().y()));
+      });
+      quadrature.next();
+      border_of_integral.push_back(k);
+    }
+  }
+
+  const auto &results = quadrature.integrate();
+  for (int k = 0; k < border_of_integral.size(); k++) {
+    const int b = border_of_integral[k];
+    integral[b] = results[k];
+  }
+  mirror_borders(integral);
+  return integral;
+}
+
+void PowerDiagram::mirror_borders(std::vector<double> &values) const {
+  /* Rows are sorted by neighbour index */
+  for (int i = 0; i < sites.size(); i++) {
+    for (int k = neighbour_offsets[i]; k < neighbour_offsets[i + 1]; k++) {
+      const int j = neighbours[k];
+      if (j > i) {
+        continue;
+      }
+      auto begin = neighbours.begin() + neighbour_offsets[j];
+      auto end = neighbours.begin() + neighbour_offsets[j + 1];
+      auto it = std::lower_bound(begin, end, i);
+      if (it != end && *it == i) {
+        values[k] = values[it - neighbours.begin()];
+      }
+    }
+  }
+}
+
+std::vector<double>
+PowerDiagram::integral(const RasterDensity &density) const {
+  scoped_timer timer(Integration);
+  std::vector<double> integral(sites.size(), 0);
+  if (not is_cropped) {
+    std::cerr << "Power diagram not cropped, please use crop method fisrt."
+              << std::endl;
+    return integral;
+  }
+  std::vector<double> xy;
+  for (int i = 0; i < sites.size(); i++) {
+    xy.clear();
+    for (int k = cell_offsets[i]; k < cell_offsets[i + 1]; k++) {
+      xy.push_back(CGAL::to_double(cell_vertices[k].x()));
+      xy.push_back(CGAL::to_double(cell_vertices[k].y()));
+    }
+    integral[i] = density.polygon_mass(xy.data(), xy.size() / 2);
+  }
+  return integral;
+}
+
+std::vector<double>
+PowerDiagram::border_integral(const RasterDensity &density) const {
+  scoped_timer timer(Integration);
+  std::vector<double> integral(neighbours.size(), 0);
+  if (not is_cropped) {
+    std::cerr << "Power diagram not cropped, please use crop method fisrt."
+              << std::endl;
+    return integral;
+  }
+  for (int i = 0; i < sites.size(); i++) {
+    for (int k = neighbour_offsets[i]; k < neighbour_offsets[i + 1]; k++) {
+      if (neighbours[k] > i) {
+        for_each_border_piece(k, [&](const K::Segment_2 &s) {
+          integral[k] += density.segment_mass(CGAL::to_double(s.source().x()),
+                                              CGAL::to_double(s.source().y()),
+                                              CGAL::to_double(s.target().x()),
+                                              CGAL::to_double(s.target().y()));
+        });
+      }
+    }
+  }
+  mirror_borders(integral);
+  return integral;
+}
@@ -0,0 +1,159 @@
+#include <barycenter.hpp>
+#include <deque>
+
+/* Kantorovich dual functional of the semi-discrete problem for the uniform
+ * measure, concave in the potentials, whose gradient is the discrete plan
+ * minus the cell masses. Those are the cell areas, so the transport cost is
+ * integrated against the area as well, not against the normalized measure. */
+double WassersteinBarycenter::dual_value() const {
+  double value = transport_cost() * support_area;
+  for (int j : valid_column_variables) {
+    value += potential[j] * gradient[j];
+  }
+  return value;
+}
+
+/* Quasi-Newton ascent of the dual functional, with the last potential fixed.
+ * It only pays for cell masses and moments, and stops on the same residual
+ * as the Newton solvers. */
+int WassersteinBarycenter::lbfgs_iteration(int steps) {
+  if (not has_uniform_measure()) {
+    std::cout << "L-BFGS needs the transport cost, only available for the "
+                 "uniform measure."
+              << std::endl;
+    return 0;
+  }
+  const int n = valid_column_variables.size() - 1;
+  const double c_armijo = 1e-4;
+  const double c_curvature = 0.9;
+  const int max_evaluations = 40;
+
+  /* Minimize the opposite of the dual functional */
+  std::vector<double> x(n), g(n), d(n), q(n), x_next(n), g_next(n);
+  auto evaluate = [&](std::vector<double> &point,
+                      std::vector<double> &slope) {
+    for (int i = 0; i < n; i++) {
+      potential[valid_column_variables[i]] = point[i];
+    }
+    update_partition_and_gradient();
+    for (int i = 0; i < n; i++) {
+      slope[i] = -gradient[valid_column_variables[i]];
+    }
+    return -dual_value();
+  };
+  auto dot = [n](const std::vector<double> &u, const std::vector<double> &v) {
+    double sum = 0;
+    for (int i = 0; i < n; i++) {
+      sum += u[i] * v[i];
+    }
+    return sum;
+  };
+  auto has_converged = [&]() {
+    double residual = 0;
+    for (int i = 0; i < n; i++) {
+      residual += std::abs(g[i]);
+    }
+    return residual < 0.1 * tolerance;
+  };
+
+  for (int i = 0; i < n; i++) {
+    x[i] = potential[valid_column_variables[i]];
+  }
+  double f = evaluate(x, g);
+  std::deque<std::vector<double>> s_history, y_history;
+  std::deque<double> rho_history;
+  std::vector<double> alpha(lbfgs_memory);
+
+  int iter = 0;
+  while (iter < steps && not has_converged()) {
+    iter++;
+    /* Two-loop recursion, from the inverse of the typical diagonal of the
+     * Hessian, about six borders per cell, until curvature pairs exist. */
+    q = g;
+    const int m = s_history.size();
+    for (int k = m - 1; k >= 0; k--) {
+      alpha[k] = rho_history[k] * dot(s_history[k], q);
+      for (int i = 0; i < n; i++) {
+        q[i] -= alpha[k] * y_history[k][i];
+      }
+    }
+    const double gamma =
+        m > 0 ? dot(s_history.back(), y_history.back()) /
+                    dot(y_history.back(), y_history.back())
+              : support_area / 6;
+    for (int i = 0; i < n; i++) {
+      d[i] = gamma * q[i];
+    }
+    for (int k = 0; k < m; k++) {
+      const double beta = rho_history[k] * dot(y_history[k], d);
+      for (int i = 0; i < n; i++) {
+        d[i] += (alpha[k] - beta) * s_history[k][i];
+      }
+    }
+    for (int i = 0; i < n; i++) {
+      d[i] = -d[i];
+    }
+    double slope = dot(g, d);
+    if (not(slope < 0)) {
+      s_history.clear();
+      y_history.clear();
+      rho_history.clear();
+      for (int i = 0; i < n; i++) {
+        d[i] = -support_area / 6 * g[i];
+      }
+      slope = dot(g, d);
+    }
+
+    /* Weak Wolfe line search by bracketing */
+    double t = 1;
+    double t_low = 0;
+    double t_high = std::numeric_limits<double>::max();
+    double f_next = f;
+    bool accepted = false;
+    for (int e = 0; e < max_evaluations; e++) {
+      for (int i = 0; i < n; i++) {
+        x_next[i] = x[i] + t * d[i];
+      }
+      f_next = evaluate(x_next, g_next);
+      if (f_next > f + c_armijo * t * slope) {
+        t_high = t;
+      } else if (dot(g_next, d) < c_curvature * slope) {
+        t_low = t;
+      } else {
+        accepted = true;
+        break;
+      }
+      t = t_high < std::numeric_limits<double>::max() ? 0.5 * (t_low + t_high)
+                                                      : 2 * t_low;
+    }
+    if (not accepted) {
+      evaluate(x, g);
+      std::cout << "L-BFGS line search failed after " << iter
+                << " iterations." << std::endl;
+      break;
+    }
+
+    std::vector<double> s(n), y(n);
+    for (int i = 0; i < n; i++) {
+      s[i] = x_next[i] - x[i];
+      y[i] = g_next[i] - g[i];
+    }
+    const double sy = dot(s, y);
+    if (sy > 0 && lbfgs_memory > 0) {
+      if (s_history.size() == lbfgs_memory) {
+        s_history.pop_front();
+        y_history.pop_front();
+        rho_history.pop_front();
+      }
+      s_history.push_back(std::move(s));
+      y_history.push_back(std::move(y));
+      rho_history.push_back(1 / sy);
+    }
+    std::swap(x, x_next);
+    std::swap(g, g_next);
+    f = f_next;
+    Trace::global().write(Inner, "lbfgs",
+                          {{"iteration", iter}, {"step", t}, {"dual", -f}});
+  }
+  return iter;
+}
@@ -17,51 +17,44 @@ void WassersteinBarycenter::initialize_lp() {
     n_column_variables *= dist.size();
   }
 
-  for (int i = 1; i <= n_column_variables; i++) {
+  /* With column generation, columns are only added when they enter the LP */
+  const int n_lp_columns = use_column_generation ? 0 : n_column_variables;
+  for (int i = 1; i <= n_lp_columns; i++) {
     glp_add_cols(lp, 1);
     /* As a multi-marginal distribution, it must be a probability. */
 	/* But we only need a ower bound to express this thanks to the constraints. */
     glp_set_col_bnds(lp, i, GLP_LO, 0, 1);
   }
 
-  n_entries = n_column_variables * n_marginals;
+  n_entries = n_lp_columns * n_marginals;
   int *ia = new int[1 + n_entries];
   int *ja = new int[1 + n_entries];
   double *ar = new double[1 + n_entries];
-  /* discrete_plan = {0}; */
-  support_points = {K::Point_2(0, 0)};
-  squared_norm = {0};
-  column_variables = {{0}};
+  /* Points of the marginals weighted by their coefficients, so that the
+   * point of a column variable is the sum of those of its tuple. */
+  columns.clear();
+  {
+    auto coef_it = marginal_coefficients.begin();
+    const double scale = 1 - marginal_coefficients.front();
+    for (const auto &dist : marginals) {
+      coef_it++;
+      std::vector<double> x, y;
+      for (const auto &p : dist) {
+        x.push_back(CGAL::to_double(*coef_it * p.first.x()) / scale);
+        y.push_back(CGAL::to_double(*coef_it * p.first.y()) / scale);
+      }
+      columns.add_marginal(x, y);
+    }
+  }
   {
-    /* The iteration list should be bounded by dims. */
-    std::vector<int> iterate_list(n_marginals, 1);
     int record = 1;
-
-    /* j convert iterate_list into an integer */
-    for (int j = 1; j <= n_column_variables; j++) {
-
-      valid_column_variables.push_back(j);
-      column_variables.push_back(iterate_list);
-      /* x, y are for point coordinates */
-      double x = 0;
-      double y = 0;
-      auto coef_it = marginal_coefficients.begin();
-
-      /* We start with a Voronoi diagram, and uniform distribution
-       * as the initial solution. */
-      /* double proba = 1; */
+    for (int j = 1; j <= n_lp_columns; j++) {
       /* Use (m, n) as coordinate in marginals, i.e., */
       /* the n th element in the m th marginal. */
       for (int m = 1; m <= n_marginals; m++) {
-        int n = iterate_list[m - 1];
-        /* Should figure out which kind of j we should add into the list. */
-        /* We have n_marginal different j to add. */
         if (record <= n_entries) {
-          ia[record] = n;
+          ia[record] = lp_row(m, columns.digit(j, m - 1));
           ja[record] = j;
-          for (int k = 1; k < m; k++) {
-            ia[record] += dims[k - 1];
-          }
           ar[record] = 1;
           record++;
         } else {
@@ -70,37 +63,17 @@ void WassersteinBarycenter::initialize_lp() {
                     << std::endl;
           std::exit(EXIT_FAILURE);
         }
-
-        coef_it++;
-        x += CGAL::to_double((*coef_it) * marginals[m - 1][n - 1].first.x());
-        y += CGAL::to_double((*coef_it) * marginals[m - 1][n - 1].first.y());
-        /* proba *= marginals[m - 1][n - 1].second; */
-      }
-      x /= (1 - marginal_coefficients.front());
-      y /= (1 - marginal_coefficients.front());
-      /* std::cout << "Insert point " << x << ", " << y << std::endl; */
-      /* discrete_plan.push_back(proba); */
-      support_points.push_back(K::Point_2(x, y));
-      squared_norm.push_back(std::pow(x, 2) + std::pow(y, 2));
-      /* We order solution in the reverse dict order. */
-      /* It doesn't matter how we order it at all since we deal the constraint
-       * matrix at the same time. */
-      for (int k = 0; k < n_marginals; k++) {
-        if (iterate_list[k] == dims[k]) {
-          iterate_list[k] = 1;
-        } else {
-          ++iterate_list[k];
-          break;
-        }
       }
     }
+    /* We start with a Voronoi diagram, and uniform distribution
+     * as the initial solution. */
+    for (int j = 1; j <= n_column_variables; j++) {
+      valid_column_variables.push_back(j);
+    }
 
-    if (support_points.size() != n_column_variables + 1 ||
-        column_variables.size() != n_column_variables + 1 ||
+    if (columns.size() != n_column_variables ||
         valid_column_variables.size() != n_column_variables) {
-      std::cerr << "Potential initialization failed with "
-                << support_points.size() - 1 << " support points found, "
-                << column_variables.size() - 1
+      std::cerr << "Potential initialization failed with " << columns.size()
                 << " column variables indexed and "
                 << valid_column_variables.size()
                 << " variable are set to be valid, while we have "
@@ -113,10 +86,158 @@ void WassersteinBarycenter::initialize_lp() {
     }
   }
 
-  glp_load_matrix(lp, n_entries, ia, ja, ar);
+  if (use_column_generation) {
+    initialize_lp_columns();
+  } else {
+    glp_load_matrix(lp, n_entries, ia, ja, ar);
+  }
   delete[] ia;
   delete[] ja;
   delete[] ar;
   glp_term_out(GLP_OFF);
   std::cout << "Finish initializing linear programming part." << std::endl;
 }
+
+/* Row of the constraint on the n-th point of the m-th marginal, both from 1 */
+int WassersteinBarycenter::lp_row(int m, int n) const {
+  int row = n;
+  for (int k = 1; k < m; k++) {
+    row += dims[k - 1];
+  }
+  return row;
+}
+
+double WassersteinBarycenter::lp_cost(int j) const {
+  return potential[j] * marginal_coefficients.front() - squared_norm(j);
+}
+
+void WassersteinBarycenter::lp_costs(int first, int count,
+                                     double *cost) const {
+  std::vector<double> x(count), y(count);
+  columns.points(first, count, x.data(), y.data());
+  const double lambda = marginal_coefficients.front();
+  const double *p = potential.data() + first;
+  for (int i = 0; i < count; i++) {
+    cost[i] = p[i] * lambda - (x[i] * x[i] + y[i] * y[i]);
+  }
+}
+
+void WassersteinBarycenter::add_lp_column(int j) {
+  /* GLPK arrays are indexed from 1 */
+  lp_column_rows.resize(1 + n_marginals);
+  lp_column_ones.assign(1 + n_marginals, 1);
+  for (int m = 1; m <= n_marginals; m++) {
+    lp_column_rows[m] = lp_row(m, columns.digit(j, m - 1));
+  }
+  const int k = glp_add_cols(lp, 1);
+  glp_set_col_bnds(lp, k, GLP_LO, 0, 1);
+  glp_set_mat_col(lp, k, n_marginals, lp_column_rows.data(),
+                  lp_column_ones.data());
+  lp_columns.push_back(j);
+  is_lp_column[j] = true;
+}
+
+/* The restricted LP starts from the columns of the north-west corner rule,
+ * whose plan has the given marginals, so that it is always feasible. */
+void WassersteinBarycenter::initialize_lp_columns() {
+  lp_columns = {0};
+  is_lp_column.assign(n_column_variables + 1, false);
+  std::vector<int> index(n_marginals, 0);
+  std::vector<double> left(n_marginals);
+  for (int m = 0; m < n_marginals; m++) {
+    left[m] = marginals[m][0].second;
+  }
+  while (true) {
+    const int j = columns.column(index);
+    if (not is_lp_column[j]) {
+      add_lp_column(j);
+    }
+    const int m_min = std::min_element(left.begin(), left.end()) - left.begin();
+    const double t = left[m_min];
+    for (double &l : left) {
+      l -= t;
+    }
+    if (++index[m_min] == dims[m_min]) {
+      break;
+    }
+    left[m_min] = marginals[m_min][index[m_min]].second;
+  }
+  std::cout << "Column generation starts from " << lp_columns.size() - 1
+            << " of the " << n_column_variables << " column variables."
+            << std::endl;
+}
+
+/* Add the column variables of most negative reduced cost for the row duals
+ * of the last simplex, at most column_generation_batch of them, or as many as
+ * rows if it is not positive. Returns the number of added columns. */
+int WassersteinBarycenter::price_lp_columns() {
+  std::vector<double> dual(n_row_variables + 1);
+  for (int r = 1; r <= n_row_variables; r++) {
+    dual[r] = glp_get_row_dual(lp, r);
+  }
+  std::vector<std::pair<double, int>> entering;
+  const int chunk = 4096;
+  std::vector<double> cost(chunk);
+  for (int first = 1; first <= n_column_variables; first += chunk) {
+    const int count = std::min(chunk, n_column_variables - first + 1);
+    lp_costs(first, count, cost.data());
+    for (int i = 0; i < count; i++) {
+      const int j = first + i;
+      if (is_lp_column[j]) {
+        continue;
+      }
+      double reduced_cost = cost[i];
+      for (int m = 1; m <= n_marginals; m++) {
+        reduced_cost -= dual[lp_row(m, columns.digit(j, m - 1))];
+      }
+      if (reduced_cost < -column_generation_tolerance) {
+        entering.push_back({reduced_cost, j});
+      }
+    }
+  }
+  const int batch = column_generation_batch > 0 ? column_generation_batch
+                                                : n_row_variables;
+  if (entering.size() > batch) {
+    std::nth_element(entering.begin(), entering.begin() + batch,
+                     entering.end());
+    entering.resize(batch);
+  }
+  for (const auto &[reduced_cost, j] : entering) {
+    add_lp_column(j);
+    glp_set_obj_coef(lp, lp_columns.size() - 1, lp_cost(j));
+  }
+  return entering.size();
+}
+
+/* With two marginals the LP is a transportation problem between them. The
+ * column variable of the pair (i, k) of points is 1 + i + k * dims[0], so
+ * the costs of the column variables in order are the cost matrix from the
+ * points of the second marginal to those of the first one. */
+bool WassersteinBarycenter::update_transport_plan() {
+  const int m = dims[0];
+  const int n = dims[1];
+  if (transport.rows() != n || transport.columns() != m) {
+    std::vector<double> supply(n), demand(m);
+    for (int k = 0; k < n; k++) {
+      supply[k] = marginals[1][k].second;
+    }
+    for (int i = 0; i < m; i++) {
+      demand[i] = marginals[0][i].second;
+    }
+    transport.reset(supply, demand);
+  }
+  lp_cost_matrix.resize(m * n);
+  lp_costs(1, m * n, lp_cost_matrix.data());
+  {
+    scoped_timer timer(Simplex);
+    if (transport.solve(lp_cost_matrix) < 0) {
+      return false;
+    }
+  }
+  std::vector<std::pair<int, double>> entries;
+  transport.for_each_flow([&entries, m](int k, int i, double flow) {
+    entries.push_back({1 + i + k * m, flow});
+  });
+  discrete_plan.assign(entries);
+  return true;
+}
@@ -119,3 +119,40 @@ WassersteinBarycenter::get_marginal_coefficients(int argc, char *argv[]) {
   }
   return coefs;
 }
+
+void WassersteinBarycenter::set_raster_density(int n_columns, int n_rows,
+                                               std::vector<double> pixels) {
+  const auto box = support_polygon.bbox();
+  raster = RasterDensity(box.xmin(), box.ymin(), box.xmax(), box.ymax(),
+                         n_columns, n_rows, std::move(pixels));
+  /* The cells only cover the support, whose masses must add up to those of
+   * the plan */
+  std::vector<double> xy;
+  for (const auto &p : support_polygon.vertices()) {
+    xy.push_back(CGAL::to_double(p.x()));
+    xy.push_back(CGAL::to_double(p.y()));
+  }
+  raster.normalize(xy.data(), support_polygon.size());
+  support_measure = Raster;
+}
+
+/* The file starts with the numbers of columns and rows, followed by the
+ * pixel values row by row from the bottom of the support. */
+void WassersteinBarycenter::read_raster_density(const char *filename) {
+  std::ifstream file(filename);
+  int n_columns = 0, n_rows = 0;
+  if (not(file >> n_columns >> n_rows) || n_columns < 1 || n_rows < 1) {
+    std::cerr << "Find no raster size in file " << filename << "."
+              << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+  std::vector<double> pixels;
+  pixels.reserve(n_columns * n_rows);
+  double p;
+  while (pixels.size() < n_columns * n_rows && file >> p) {
+    pixels.push_back(p);
+  }
+  std::cout << "Read a raster density of " << n_columns << " x " << n_rows
+            << " pixels from " << filename << "." << std::endl;
+  set_raster_density(n_columns, n_rows, std::move(pixels));
+}
@@ -0,0 +1,110 @@
+#include <barycenter.hpp>
+
+/* Group the given column variables in about m clusters of nearby support
+ * points, by a uniform grid over their bounding box. The representative of
+ * a cluster is the variable closest to its barycenter, and representative[i]
+ * is the one of variables[i]. */
+void WassersteinBarycenter::cluster_column_variables(
+    const std::vector<int> &variables, int m, std::vector<int> &representative) {
+  const int n = variables.size();
+  double x_min = std::numeric_limits<double>::max();
+  double y_min = x_min;
+  double x_max = -x_min;
+  double y_max = -x_min;
+  for (int j : variables) {
+    const double x = CGAL::to_double(support_point(j).x());
+    const double y = CGAL::to_double(support_point(j).y());
+    x_min = std::min(x_min, x);
+    x_max = std::max(x_max, x);
+    y_min = std::min(y_min, y);
+    y_max = std::max(y_max, y);
+  }
+  const int g = std::max<int>(1, std::lround(std::sqrt(m)));
+  const double width = std::max(x_max - x_min, 1e-12) / g;
+  const double height = std::max(y_max - y_min, 1e-12) / g;
+  auto cell = [&](int j) {
+    const double x = CGAL::to_double(support_point(j).x());
+    const double y = CGAL::to_double(support_point(j).y());
+    const int c_x = std::min<int>((x - x_min) / width, g - 1);
+    const int c_y = std::min<int>((y - y_min) / height, g - 1);
+    return c_y * g + c_x;
+  };
+
+  std::vector<double> mass(g * g, 0);
+  std::vector<double> x_sum(g * g, 0);
+  std::vector<double> y_sum(g * g, 0);
+  for (int j : variables) {
+    const int c = cell(j);
+    mass[c] += discrete_plan[j];
+    x_sum[c] += discrete_plan[j] * CGAL::to_double(support_point(j).x());
+    y_sum[c] += discrete_plan[j] * CGAL::to_double(support_point(j).y());
+  }
+  std::vector<int> closest(g * g, -1);
+  std::vector<double> distance(g * g, std::numeric_limits<double>::max());
+  for (int j : variables) {
+    const int c = cell(j);
+    const K::Point_2 barycenter(x_sum[c] / mass[c], y_sum[c] / mass[c]);
+    const double d =
+        CGAL::to_double(CGAL::squared_distance(support_point(j), barycenter));
+    if (d < distance[c]) {
+      distance[c] = d;
+      closest[c] = j;
+    }
+  }
+  representative.resize(n);
+  for (int i = 0; i < n; i++) {
+    representative[i] = closest[cell(variables[i])];
+  }
+}
+
+void WassersteinBarycenter::solve_coarse_levels(int steps) {
+  const std::vector<int> variables = valid_column_variables;
+  const SparsePlan plan = discrete_plan;
+  const int n = variables.size();
+  if (multiscale_ratio < 2) {
+    return;
+  }
+  std::vector<int> sizes;
+  for (int m = n / multiscale_ratio; m >= multiscale_min_points;
+       m /= multiscale_ratio) {
+    sizes.push_back(m);
+  }
+
+  /* From the coarsest level on, each solution is the initial potential of
+   * all the variables it represents. */
+  std::vector<int> representative;
+  for (auto sit = sizes.rbegin(); sit != sizes.rend(); ++sit) {
+    cluster_column_variables(variables, *sit, representative);
+    discrete_plan = plan;
+    valid_column_variables.clear();
+    for (int i = 0; i < n; i++) {
+      const int j = variables[i];
+      const int r = representative[i];
+      if (r == j) {
+        valid_column_variables.push_back(j);
+      } else {
+        discrete_plan.add(r, plan[j]);
+      }
+    }
+    if (valid_column_variables.size() < 2) {
+      continue;
+    }
+    std::sort(
+        valid_column_variables.begin(), valid_column_variables.end(),
+        [this](int a, int b) { return discrete_plan[a] < discrete_plan[b]; });
+    const int iter = sparse_newton_iteration(steps);
+    if (iter < 0) {
+      std::cout << "Multiscale level of " << valid_column_variables.size()
+                << " points failed, keeping its approximate potential."
+                << std::endl;
+    } else {
+      std::cout << "Multiscale level of " << valid_column_variables.size()
+                << " points solved in " << iter << " iterations." << std::endl;
+    }
+    for (int i = 0; i < n; i++) {
+      potential[variables[i]] = potential[representative[i]];
+    }
+  }
+  discrete_plan = plan;
+  valid_column_variables = variables;
+}
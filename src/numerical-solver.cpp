@@ -5,26 +5,34 @@ void WassersteinBarycenter::dump_debug(bool exit_after_dump_debug) {
   std::cout << "Vertices to insert are written to file data/weight_points."
             << std::endl;
   std::ofstream point("data/weight_points");
-  for (auto v : partition_vertices) {
-    point << v << " " << cell_area[v] << std::endl;
+  const auto cell_areas = partition.area();
+  for (int i = 0; i < partition_vertices.size(); i++) {
+    point << partition_vertices[i] << " " << cell_areas[i] << std::endl;
   }
   print_info();
   bool has_vertice_inside_support = partition.gnuplot();
   if (has_vertice_inside_support) {
     std::cout << "Current partition has " << partition.number_of_vertices()
-              << " vertices and " << partition.borders.size() << " borders."
-              << std::endl;
-    int n_vertices_no_cell = partition.number_of_vertices() - cell_area.size();
+              << " vertices and " << partition.number_of_borders()
+              << " borders." << std::endl;
+    int n_vertices_no_cell =
+        partition.number_of_vertices() - partition.number_of_cells();
     if (n_vertices_no_cell > 0) {
       std::cout << "But there are " << n_vertices_no_cell
                 << " vertices has no cells in current support." << std::endl;
     } else {
-      for (auto p : partition.borders) {
-        double a = std::abs(K::Vector_2(p.first) * K::Vector_2(p.second));
-        if (a > 10e-6) {
-          std::cout << "The following pair of border info is invalid."
-                    << std::endl;
-          std::cerr << p.first << "\t--+--\t" << p.second << std::endl;
+      for (int i = 0; i < partition.number_of_sites(); i++) {
+        for (int k = partition.neighbour_offsets[i];
+             k < partition.neighbour_offsets[i + 1]; k++) {
+          const int j = partition.neighbours[k];
+          K::Segment_2 s(partition.site(i).point(), partition.site(j).point());
+          const auto &border = partition.borders[k];
+          double a = std::abs(K::Vector_2(s) * K::Vector_2(border));
+          if (i < j && a > 10e-6) {
+            std::cout << "The following pair of border info is invalid."
+                      << std::endl;
+            std::cerr << s << "\t--+--\t" << border << std::endl;
+          }
         }
       }
       if (exit_after_dump_debug) {
@@ -42,11 +50,11 @@ void WassersteinBarycenter::dump_debug(bool exit_after_dump_debug) {
 }
 
 void WassersteinBarycenter::print_info() {
-  if (discrete_plan.size() != n_column_variables + 1) {
+  if (n_row_variables == 0) {
     initialize_lp();
   }
 
-  if (support_points.size() != n_column_variables + 1) {
+  if (columns.size() != n_column_variables) {
     std::cerr << "Error in getting support points info." << std::endl;
     std::exit(EXIT_FAILURE);
   }
@@ -56,28 +64,29 @@ void WassersteinBarycenter::print_info() {
   }
 
   partition.use_label = true;
-  partition.label.clear();
+  partition.labels.assign(partition_vertices.size(), "");
 
   std::cout << "Index\tProbability\tPotential\tGradient\t     Point"
             << std::endl;
-  for (auto v : partition_vertices) {
-    int j = std::distance(
-        support_points.begin(),
-        std::find(support_points.begin(), support_points.end(), v.point()));
-    partition.label.insert({v, std::to_string(j)});
+  for (int i = 0; i < partition_vertices.size(); i++) {
+    const int j = valid_column_variables[i];
+    partition.labels[i] = std::to_string(j);
     std::printf("%i\t %.4f \t%.4f\t\t%.4f\t\t(%.4f, %.4f)\n", j,
                 discrete_plan[j], potential[j], gradient[j],
-                CGAL::to_double(support_points[j].x()),
-                CGAL::to_double(support_points[j].y()));
+                CGAL::to_double(support_point(j).x()),
+                CGAL::to_double(support_point(j).y()));
   }
   if (valid_column_variables.size() != n_column_variables) {
     if (n_column_variables < 10) {
       std::cout << "Following points labeled by orders are excluded from the "
                    "above discrete plan:"
                 << std::endl;
-      for (int j : dumb_column_variables) {
+      for (int j = 1; j <= n_column_variables; j++) {
+        if (discrete_plan[j] != 0) {
+          continue;
+        }
         std::cout << "(";
-        for (auto n : column_variables[j]) {
+        for (auto n : columns.tuple(j)) {
           std::cout << n << ", ";
         }
         std::cout << "\b\b), ";
@@ -89,12 +98,22 @@ void WassersteinBarycenter::print_info() {
               << " column varibales are listed in the above table."
               << std::endl;
   }
+  std::printf("Transport cost of the current partition: %.6f\n",
+              transport_cost());
+  std::printf("Memory held by the solver workspace: %.1f kB\n",
+              workspace.memory_footprint() / 1024.0);
 }
 
 void WassersteinBarycenter::saddle_point_iteration(unsigned int step,
                                                    double e) {
   tolerance = e;
   initialize_lp();
+  if (use_frank_wolfe) {
+    std::cout << std::endl;
+    frank_wolfe_iteration(step);
+    return;
+  }
+  open_solution_store();
   std::cout << std::endl;
 
   potential = std::vector<double>(n_column_variables + 1);
@@ -117,6 +136,11 @@ void WassersteinBarycenter::saddle_point_iteration(unsigned int step,
       lp_vertices_loop.insert({valid_column_variables});
     }
     semi_discrete_solver(step);
+    Trace::global().write(Outer, "lp_vertex",
+                          {{"iteration", i + 1},
+                           {"valid_variables", valid_column_variables.size()},
+                           {"error", error},
+                           {"workspace_bytes", workspace.memory_footprint()}});
   }
 
   std::cout << std::endl;
@@ -145,10 +169,11 @@ void WassersteinBarycenter::saddle_point_iteration(unsigned int step,
           discrete_plan = cached_semi_discrete_solution[v].discrete_plan;
           potential = cached_semi_discrete_solution[v].potential;
           error = cached_semi_discrete_solution[v].error;
-          for (int j = 1; j <= n_column_variables; j++) {
+          for (int k = 0; k < discrete_plan.size(); k++) {
+            const int j = discrete_plan.column(k);
             cost += (potential[j] * marginal_coefficients.front() -
-                     squared_norm[j]) *
-                    discrete_plan[j];
+                     squared_norm(j)) *
+                    discrete_plan.mass(k);
           }
           update_partition_and_gradient();
           print_info();
@@ -165,12 +190,8 @@ void WassersteinBarycenter::saddle_point_iteration(unsigned int step,
               cached_semi_discrete_solution[*(lp_iterator++)].discrete_plan;
           auto p_1 =
               cached_semi_discrete_solution[*(lp_iterator++)].discrete_plan;
-          double p_diff[n_column_variables + 1];
-          std::vector<double> convex_combination_plan;
-          p_diff[0] = 0;
-          for (int j = 1; j <= n_column_variables; j++) {
-            p_diff[j] = p_1[j] - p_0[j];
-          }
+          const SparsePlan p_diff = SparsePlan::combination(-1, p_0, 1, p_1);
+          SparsePlan convex_combination_plan;
           /* Binary search for lambda in convex combination */
           std::srand(std::time(0));
           double lambda = std::rand() / (1.0 + RAND_MAX);
@@ -180,19 +201,19 @@ void WassersteinBarycenter::saddle_point_iteration(unsigned int step,
             std::cout << std::endl;
             std::cout << "Interpolate loop vertices with coefficient " << lambda
                       << "." << std::endl;
-            for (int j = 1; j <= n_column_variables; j++) {
-              discrete_plan[j] = p_1[j] * lambda + p_0[j] * (1 - lambda);
-            }
+            discrete_plan =
+                SparsePlan::combination(1 - lambda, p_0, lambda, p_1);
             convex_combination_plan = discrete_plan;
             update_column_variables();
             potential = std::vector<double>(n_column_variables + 1, 0);
             semi_discrete_iteration(step);
             extend_concave_potential();
             double test = 0;
-            for (int j = 1; j <= n_column_variables; j++) {
+            for (int k = 0; k < p_diff.size(); k++) {
+              const int j = p_diff.column(k);
               test += (potential[j] * marginal_coefficients.front() -
-                       squared_norm[j]) *
-                      p_diff[j];
+                       squared_norm(j)) *
+                      p_diff.mass(k);
             }
             std::cout << "Balancing given vertices: " << test << "."
                       << std::endl;
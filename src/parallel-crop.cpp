@@ -18,12 +18,15 @@ void PowerDiagram::linear_crop() {
     return;
 
   is_cropped = true;
-  borders.clear();
+  crop_buffer buffer;
 
-  std::set<vertex, less> dual_vertices;
+  auto by_site = [](Vertex_handle u, Vertex_handle v) {
+    return less()(u->point(), v->point());
+  };
+  std::set<Vertex_handle, decltype(by_site)> dual_vertices(by_site);
   double minimal_weight = dual_rt.finite_vertices_begin()->point().weight();
   for (auto v : dual_rt.finite_vertex_handles()) {
-    dual_vertices.insert(v->point());
+    dual_vertices.insert(v);
     double w = v->point().weight();
     if (w < minimal_weight) {
       minimal_weight = w;
@@ -34,25 +37,30 @@ void PowerDiagram::linear_crop() {
   FACE_CASE d1 = CURRENT_INFINITE_NEXT_INFINITE;
   for (auto vit = dual_vertices.begin(); vit != dual_vertices.end();) {
     auto record = ParallelRecord(cropped_shape, &d1);
-    auto c1 = K::Circle_2(vit->point(), vit->weight() - minimal_weight + 1);
+    const vertex &v1 = (*vit)->point();
+    auto c1 = K::Circle_2(v1.point(), v1.weight() - minimal_weight + 1);
+    const int i = (*vit)->info();
     if (++vit != dual_vertices.end()) {
-      auto c2 = K::Circle_2(vit->point(), vit->weight() - minimal_weight + 1);
+      const vertex &v2 = (*vit)->point();
+      auto c2 = K::Circle_2(v2.point(), v2.weight() - minimal_weight + 1);
       auto line = CGAL::radical_line(c1, c2);
       auto segment = K::Segment_2(c1.center(), c2.center());
       record.intersect(line);
       record.remove_duplicate();
       divider_lines.push_back({segment, record});
-      borders.insert({segment, K::Segment_2(record.points().front(),
-                                            record.points().back())});
+      buffer.borders.push_back(
+          {i, (*vit)->info(),
+           K::Segment_2(record.points().front(), record.points().back())});
     }
   }
 
   for (auto vci = dual_vertices.begin(); vci != dual_vertices.end(); ++vci) {
     auto segment = divider_lines.front().first;
     auto record = divider_lines.front().second;
+    const vertex &v = (*vci)->point();
 
-    if (segment.source() != vci->point() && segment.target() != vci->point()) {
-      std::cerr << "Segment " << segment << " mismatches with vertex " << *vci
+    if (segment.source() != v.point() && segment.target() != v.point()) {
+      std::cerr << "Segment " << segment << " mismatches with vertex " << v
                 << std::endl;
       continue;
     }
@@ -60,7 +68,7 @@ void PowerDiagram::linear_crop() {
     chain cell_chain = {};
     if (vci == dual_vertices.begin() || vci == --dual_vertices.end()) {
       // Add only current record to the chain
-      record.complete(&cell_chain, vci->point());
+      record.complete(&cell_chain, v.point());
     } else {
       // Add also next record to the chain
       std::cerr << "Not implemented yet for multiple colinear dual!"
@@ -70,10 +78,15 @@ void PowerDiagram::linear_crop() {
     }
 
     if (cell_chain.size() > 2) {
-      auto cell_border = polygon(cell_chain.begin(), cell_chain.end());
-      cropped_cells.insert({*vci, cell_border});
+      const int first = buffer.vertices.size();
+      buffer.vertices.insert(buffer.vertices.end(), cell_chain.begin(),
+                             cell_chain.end());
+      close_cell(buffer, (*vci)->info(), first);
     }
   }
+
+  std::vector<crop_buffer> buffers = {buffer};
+  assemble(buffers, {});
 }
 
 void ParallelRecord::remove_duplicate() {
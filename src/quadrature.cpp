@@ -0,0 +1,145 @@
+#include "quadrature.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+/* Symmetric orbits of a triangle rule: the centroid, the 3 permutations of
+ * (a, a, 1 - 2a) and the 6 permutations of (a, b, 1 - a - b). */
+struct orbit {
+  int size;
+  double weight;
+  double a;
+  double b;
+};
+
+/* Radon's 7 points rule, exact up to degree 5 */
+const orbit degree_5[] = {
+    {1, 0.225, 1.0 / 3, 1.0 / 3},
+    {3, 0.132394152788506, 0.470142064105115, 0},
+    {3, 0.125939180544827, 0.101286507323456, 0},
+};
+
+/* Dunavant's 16 points rule, exact up to degree 8 */
+const orbit degree_8[] = {
+    {1, 0.144315607677787, 1.0 / 3, 1.0 / 3},
+    {3, 0.095091634267285, 0.459292588292723, 0},
+    {3, 0.103217370534718, 0.170569307751760, 0},
+    {3, 0.032458497623198, 0.050547228317031, 0},
+    {6, 0.027230314174435, 0.008394777409958, 0.263112829634638},
+};
+
+/* Gauss-Legendre nodes on [0, 1] */
+const double gauss_3_nodes[] = {0.112701665379258, 0.5, 0.887298334620742};
+const double gauss_3_weights[] = {5.0 / 18, 8.0 / 18, 5.0 / 18};
+const double gauss_5_nodes[] = {0.046910077030668, 0.230765344947158, 0.5,
+                                0.769234655052842, 0.953089922969332};
+const double gauss_5_weights[] = {0.118463442528095, 0.239314335249683,
+                                  0.284444444444444, 0.239314335249683,
+                                  0.118463442528095};
+} // namespace
+
+void CellQuadrature::set_degree(int degree) {
+  auto add_node = [this](double weight, double a, double b) {
+    triangle_nodes.push_back(a);
+    triangle_nodes.push_back(b);
+    triangle_weights.push_back(weight);
+  };
+  auto add_orbits = [&](const auto &orbits) {
+    for (const orbit &o : orbits) {
+      if (o.size == 1) {
+        add_node(o.weight, o.a, o.b);
+      } else if (o.size == 3) {
+        const double c = 1 - 2 * o.a;
+        add_node(o.weight, o.a, o.a);
+        add_node(o.weight, o.a, c);
+        add_node(o.weight, c, o.a);
+      } else {
+        const double c = 1 - o.a - o.b;
+        add_node(o.weight, o.a, o.b);
+        add_node(o.weight, o.b, o.a);
+        add_node(o.weight, o.a, c);
+        add_node(o.weight, c, o.a);
+        add_node(o.weight, o.b, c);
+        add_node(o.weight, c, o.b);
+      }
+    }
+  };
+  if (degree <= 5) {
+    add_orbits(degree_5);
+    segment_nodes.assign(gauss_3_nodes, gauss_3_nodes + 3);
+    segment_weights.assign(gauss_3_weights, gauss_3_weights + 3);
+  } else {
+    add_orbits(degree_8);
+    segment_nodes.assign(gauss_5_nodes, gauss_5_nodes + 5);
+    segment_weights.assign(gauss_5_weights, gauss_5_weights + 5);
+  }
+}
+
+void CellQuadrature::add_triangle(double a_x, double a_y, double b_x,
+                                  double b_y, double c_x, double c_y) {
+  const double u_x = b_x - a_x;
+  const double u_y = b_y - a_y;
+  const double v_x = c_x - a_x;
+  const double v_y = c_y - a_y;
+  /* Signed, so that fans of concave cells cancel outside the cell */
+  const double area = 0.5 * (u_x * v_y - u_y * v_x);
+  if (is_uniform()) {
+    weights.push_back(area);
+    return;
+  }
+  for (int k = 0; k < triangle_weights.size(); k++) {
+    const double s = triangle_nodes[2 * k];
+    const double t = triangle_nodes[2 * k + 1];
+    points.push_back(a_x + s * u_x + t * v_x);
+    points.push_back(a_y + s * u_y + t * v_y);
+    weights.push_back(area * triangle_weights[k]);
+  }
+}
+
+void CellQuadrature::add_segment(double a_x, double a_y, double b_x,
+                                 double b_y) {
+  const double u_x = b_x - a_x;
+  const double u_y = b_y - a_y;
+  const double length = std::sqrt(u_x * u_x + u_y * u_y);
+  if (is_uniform()) {
+    weights.push_back(length);
+    return;
+  }
+  for (int k = 0; k < segment_weights.size(); k++) {
+    points.push_back(a_x + segment_nodes[k] * u_x);
+    points.push_back(a_y + segment_nodes[k] * u_y);
+    weights.push_back(length * segment_weights[k]);
+  }
+}
+
+const std::vector<double> &CellQuadrature::integrate() {
+  if (offsets.back() != weights.size()) {
+    next();
+  }
+  const size_t n = weights.size();
+  values.resize(n);
+  if (is_uniform()) {
+    std::fill(values.begin(), values.end(), 1.0);
+  } else if (batch != nullptr) {
+    batch(points.data(), n, values.data(), params);
+  } else {
+    for (size_t k = 0; k < n; k++) {
+      values[k] = pointwise->f(&points[2 * k], 2, pointwise->params);
+    }
+  }
+
+  const int n_integrals = offsets.size() - 1;
+  results.assign(n_integrals, 0);
+  for (int i = 0; i < n_integrals; i++) {
+    double sum = 0;
+    for (int k = offsets[i]; k < offsets[i + 1]; k++) {
+      sum += weights[k] * values[k];
+    }
+    results[i] = sum;
+  }
+
+  points.clear();
+  weights.clear();
+  offsets.assign(1, 0);
+  return results;
+}
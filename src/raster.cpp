@@ -0,0 +1,160 @@
+#include "raster.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+RasterDensity::RasterDensity(double x_min, double y_min, double x_max,
+                             double y_max, int n_columns, int n_rows,
+                             std::vector<double> values)
+    : x_min(x_min), y_min(y_min), x_max(x_max), y_max(y_max),
+      n_columns(n_columns), n_rows(n_rows), pixels(std::move(values)) {
+  if (n_columns < 1 || n_rows < 1 || x_max <= x_min || y_max <= y_min ||
+      pixels.size() != n_columns * n_rows) {
+    std::cerr << "Invalid raster density of " << pixels.size()
+              << " pixels for a " << n_columns << " x " << n_rows << " grid."
+              << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+  dx = (x_max - x_min) / n_columns;
+  dy = (y_max - y_min) / n_rows;
+
+  double total = 0;
+  for (double &p : pixels) {
+    if (p < 0) {
+      p = 0;
+    }
+    total += p;
+  }
+  if (total == 0) {
+    std::cerr << "Raster density has no mass." << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+  for (double &p : pixels) {
+    p /= total * dx * dy;
+  }
+
+  prefix.assign((n_columns + 1) * n_rows, 0);
+  for (int j = 0; j < n_rows; j++) {
+    double *row = &prefix[j * (n_columns + 1)];
+    for (int i = 0; i < n_columns; i++) {
+      row[i + 1] = row[i] + pixels[j * n_columns + i] * dx;
+    }
+  }
+}
+
+void RasterDensity::normalize(const double *xy, int n) {
+  const double mass = polygon_mass(xy, n);
+  if (not(mass > 0)) {
+    std::cerr << "Raster density has no mass inside the support." << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+  for (double &p : pixels) {
+    p /= mass;
+  }
+  for (double &p : prefix) {
+    p /= mass;
+  }
+}
+
+double RasterDensity::value(double x, double y) const {
+  const int i = std::floor((x - x_min) / dx);
+  const int j = std::floor((y - y_min) / dy);
+  if (i < 0 || i >= n_columns || j < 0 || j >= n_rows) {
+    return 0;
+  }
+  return pixels[j * n_columns + i];
+}
+
+double RasterDensity::row_integral(int j, double x) const {
+  const double u = std::clamp((x - x_min) / dx, 0.0, double(n_columns));
+  const int i = std::min<int>(u, n_columns - 1);
+  return prefix[j * (n_columns + 1) + i] +
+         (u - i) * pixels[j * n_columns + i] * dx;
+}
+
+/* By Green's theorem, the mass of a polygon is the integral along its
+ * boundary of F(x, y) dy, where F is the integral of the row at height y from
+ * x_min to x. Each edge is split where it crosses grid lines: on each piece
+ * the row and the pixel are fixed, F is linear along the piece, and its
+ * midpoint value is exact. Edges traversed back and forth, such as the cuts
+ * joining the rings of a cell, cancel out, and concave parts are handled as
+ * well as convex ones. */
+double RasterDensity::polygon_mass(const double *xy, int n) const {
+  if (n < 3) {
+    return 0;
+  }
+  std::vector<double> breaks;
+  double mass = 0;
+  for (int k = 0; k < n; k++) {
+    const int l = k + 1 < n ? k + 1 : 0;
+    const double a_x = xy[2 * k], a_y = xy[2 * k + 1];
+    const double u_x = xy[2 * l] - a_x, u_y = xy[2 * l + 1] - a_y;
+    if (u_y == 0) {
+      continue;
+    }
+    breaks.assign({0, 1});
+    add_grid_crossings(breaks, a_x, u_x, x_min, dx, n_columns);
+    add_grid_crossings(breaks, a_y, u_y, y_min, dy, n_rows);
+    std::sort(breaks.begin(), breaks.end());
+    for (int b = 0; b + 1 < breaks.size(); b++) {
+      const double s = std::clamp(breaks[b], 0.0, 1.0);
+      const double t = std::clamp(breaks[b + 1], 0.0, 1.0);
+      if (t <= s) {
+        continue;
+      }
+      const double m = 0.5 * (s + t);
+      const double y = a_y + m * u_y;
+      if (y < y_min || y >= y_max) {
+        continue;
+      }
+      const int j = std::min<int>((y - y_min) / dy, n_rows - 1);
+      mass += (t - s) * u_y * row_integral(j, a_x + m * u_x);
+    }
+  }
+  /* Positive for counterclockwise cells, whatever the orientation here */
+  return std::abs(mass);
+}
+
+/* Add the parameters t in [0, 1] where a + t u crosses the lines
+ * origin + k step, for k from 0 to n. */
+void RasterDensity::add_grid_crossings(std::vector<double> &breaks, double a,
+                                       double u, double origin, double step,
+                                       int n) {
+  if (u == 0) {
+    return;
+  }
+  const double lo = (std::min(a, a + u) - origin) / step;
+  const double hi = (std::max(a, a + u) - origin) / step;
+  for (int k = std::max<int>(std::ceil(lo), 0);
+       k <= std::min<int>(std::floor(hi), n); k++) {
+    breaks.push_back((origin + k * step - a) / u);
+  }
+}
+
+double RasterDensity::segment_mass(double a_x, double a_y, double b_x,
+                                   double b_y) const {
+  const double u_x = b_x - a_x;
+  const double u_y = b_y - a_y;
+  const double length = std::sqrt(u_x * u_x + u_y * u_y);
+  if (length == 0) {
+    return 0;
+  }
+
+  /* Split the segment where it crosses grid lines, the density is constant
+   * on each piece. */
+  std::vector<double> breaks{0, 1};
+  add_grid_crossings(breaks, a_x, u_x, x_min, dx, n_columns);
+  add_grid_crossings(breaks, a_y, u_y, y_min, dy, n_rows);
+  std::sort(breaks.begin(), breaks.end());
+
+  double mass = 0;
+  for (int b = 0; b + 1 < breaks.size(); b++) {
+    const double s = std::clamp(breaks[b], 0.0, 1.0);
+    const double t = std::clamp(breaks[b + 1], 0.0, 1.0);
+    if (t > s) {
+      const double m = 0.5 * (s + t);
+      mass += (t - s) * value(a_x + m * u_x, a_y + m * u_y);
+    }
+  }
+  return mass * length;
+}
@@ -1,5 +1,12 @@
 #include "intersection.hpp"
 #include "power-diagram.hpp"
+#include <thread>
+
+void PowerDiagram::update_dual(Face_handle f) {
+  auto center = dual_rt.dual(f);
+  vertex_of_face[f] = center;
+  is_inside[f] = cropped_shape.bounded_side(center) != CGAL::ON_UNBOUNDED_SIDE;
+}
 
 void PowerDiagram::rotate_crop() {
   if (dual_rt.dimension() != 2)
@@ -12,154 +19,396 @@ void PowerDiagram::rotate_crop() {
   // The definition of infinite vertex is given at
   // https://doc.cgal.org/latest/Triangulation_2/classCGAL_1_1Triangulation__2.html
 
-  std::list<Regular_triangulation::Edge> edges;
-  std::unordered_map<Regular_triangulation::Face_handle, bool> is_inside;
-  for (auto f : dual_rt.finite_face_handles()) {
-    edges.push_back({f, 0});
-    edges.push_back({f, 1});
-    edges.push_back({f, 2});
-    is_inside.insert({f, cropped_shape.bounded_side(vertex_of_face[f]) !=
-                             CGAL::ON_UNBOUNDED_SIDE});
+  std::vector<Vertex_handle> cells;
+  for (auto vh : dual_rt.finite_vertex_handles()) {
+    cells.push_back(vh);
   }
+  crop_cells(cells);
+}
 
-  for (auto e : edges) {
-    Regular_triangulation::Face_handle f = e.first;
-    int i = e.second;
+void PowerDiagram::crop_cells(const std::vector<Vertex_handle> &cells,
+                              const std::vector<char> &recropped) {
+  scoped_timer timer(Crop);
+  const int n = cells.size();
+  int n_workers = n_threads;
+#ifdef USE_EXACT_KERNEL
+  /* Lazy exact numbers of dual vertices are shared between cells. */
+  n_workers = 1;
+#endif
+  n_workers = std::max(1, std::min(n_workers, n / min_cells_per_thread));
+
+  /* Each worker crops a contiguous range of cells into its own buffer. */
+  std::vector<crop_buffer> buffers(n_workers);
+  auto work = [&](int w) {
+    for (int k = n * w / n_workers; k < n * (w + 1) / n_workers; k++) {
+      crop_cell(cells[k], buffers[w]);
+    }
+  };
+  if (n_workers == 1) {
+    work(0);
+  } else {
+    std::vector<std::thread> pool;
+    for (int w = 1; w < n_workers; w++) {
+      pool.emplace_back(work, w);
+    }
+    work(0);
+    for (auto &t : pool) {
+      t.join();
+    }
+  }
+  for (const auto &buffer : buffers) {
+    Trace::global().count(IntersectionTests,
+                          buffer.n_tests + buffer.clipper.n_clips);
+  }
+  assemble(buffers, recropped);
+}
 
-    vertex v = f->vertex(Regular_triangulation::cw(i))->point();
-    if (cropped_cells.contains(v))
+void PowerDiagram::assemble(std::vector<crop_buffer> &buffers,
+                            const std::vector<char> &recropped) {
+  const int n = sites.size();
+  const bool keep_previous = recropped.size() == n;
+  auto keep = [&](int i) { return keep_previous && not recropped[i]; };
+
+  /* Cell vertices */
+  std::vector<std::pair<int, int>> source(n, {-1, -1});
+  for (int b = 0; b < buffers.size(); b++) {
+    for (int c = 0; c < buffers[b].cells.size(); c++) {
+      source[buffers[b].cells[c]] = {b, c};
+    }
+  }
+  std::vector<int> offsets(n + 1, 0);
+  for (int i = 0; i < n; i++) {
+    int size = 0;
+    auto [b, c] = source[i];
+    if (b >= 0) {
+      size = buffers[b].vertex_offsets[c + 1] - buffers[b].vertex_offsets[c];
+    } else if (keep(i)) {
+      size = cell_offsets[i + 1] - cell_offsets[i];
+    }
+    offsets[i + 1] = offsets[i] + size;
+  }
+  std::vector<K::Point_2> vertices(offsets[n]);
+  std::vector<cell_moments> cell_moments_list(n);
+  n_cells = 0;
+  for (int i = 0; i < n; i++) {
+    auto [b, c] = source[i];
+    if (b >= 0) {
+      auto first = buffers[b].vertices.begin();
+      std::copy(first + buffers[b].vertex_offsets[c],
+                first + buffers[b].vertex_offsets[c + 1],
+                vertices.begin() + offsets[i]);
+      cell_moments_list[i] = buffers[b].moments[c];
+    } else if (keep(i)) {
+      std::copy(cell_vertices.begin() + cell_offsets[i],
+                cell_vertices.begin() + cell_offsets[i + 1],
+                vertices.begin() + offsets[i]);
+      cell_moments_list[i] = moments[i];
+    }
+    if (offsets[i + 1] - offsets[i] > 2) {
+      n_cells++;
+    }
+  }
+  cell_offsets = std::move(offsets);
+  cell_vertices = std::move(vertices);
+  moments = std::move(cell_moments_list);
+
+  /* Borders. Both sides of a border are usually found, keep the one found
+   * from the site of smaller index so that the result does not depend on
+   * the order of cropping. */
+  std::vector<border_entry> entries;
+  for (int i = 0; i < n && keep_previous; i++) {
+    if (not keep(i)) {
       continue;
-
-    auto current_f = f;
-    auto last_f = f;
-    chain cell_chain;
-
-    enum FACE_CASE debug_info;
-    RotationRecord record{cropped_shape, &debug_info};
-    bool should_complete_with_support = false;
-
-    do {
-      bool next_is_infinite = dual_rt.is_infinite(current_f->neighbor(i));
-      bool current_is_infinite = dual_rt.is_infinite(current_f);
-      bool vertex_inserted = false;
-      vertex next_v = current_f->vertex(Regular_triangulation::ccw(i))->point();
-
-      if (not current_is_infinite && is_inside[current_f]) {
-        auto vertex = vertex_of_face[current_f];
-        if (cell_chain.back() != vertex)
-          cell_chain.push_back(vertex);
-        /* std::cout << "Insert " << center[current_f] << std::endl; */
-        vertex_inserted = true;
+    }
+    for (int k = neighbour_offsets[i]; k < neighbour_offsets[i + 1]; k++) {
+      if (border_piece_offsets[k] == border_piece_offsets[k + 1]) {
+        entries.push_back({i, neighbours[k], borders[k], border_lengths[k]});
       }
-
-      if (current_is_infinite && next_is_infinite) {
-        debug_info = CURRENT_INFINITE_NEXT_INFINITE;
+      for (int p = border_piece_offsets[k]; p < border_piece_offsets[k + 1];
+           p++) {
+        entries.push_back({i, neighbours[k], border_pieces[p]});
       }
-
-      if (current_is_infinite != next_is_infinite) {
-        auto directional_vec = CGAL::Vector_2<K>(v.point(), next_v.point())
-                                   .perpendicular(CGAL::COUNTERCLOCKWISE);
-        K::Point_2 source;
-        if (next_is_infinite) {
-          debug_info = CURRENT_FINITE_NEXT_INFINITE;
-          source = vertex_of_face[current_f];
-        } else {
-          debug_info = CURRENT_INFINITE_NEXT_FINITE;
-          directional_vec = -directional_vec;
-          source = vertex_of_face[current_f->neighbor(i)];
+    }
+  }
+  for (auto &buffer : buffers) {
+    entries.insert(entries.end(), buffer.borders.begin(),
+                   buffer.borders.end());
+  }
+  auto key = [](const border_entry &e) {
+    return std::tuple(std::min(e.i, e.j), std::max(e.i, e.j), e.i > e.j);
+  };
+  std::stable_sort(entries.begin(), entries.end(),
+                   [&](const border_entry &e1, const border_entry &e2) {
+                     return key(e1) < key(e2);
+                   });
+  /* A border cut by a non-convex support comes in several pieces from the
+   * same side, merge them into the segment spanning all of them, and keep
+   * the pieces of merged entry e from pieces[piece_offsets[e]] on. */
+  std::vector<K::Segment_2> pieces;
+  std::vector<int> piece_offsets{0};
+  int n_entries = 0;
+  for (int first = 0; first < entries.size();) {
+    int last = first + 1;
+    while (last < entries.size() && key(entries[last]) == key(entries[first])) {
+      last++;
+    }
+    border_entry merged = entries[first];
+    if (merged.length < 0) {
+      merged.length = std::sqrt(CGAL::to_double(merged.segment.squared_length()));
+    }
+    if (last - first > 1) {
+      for (int k = first; k < last; k++) {
+        pieces.push_back(entries[k].segment);
+      }
+      const K::Vector_2 d = merged.segment.to_vector();
+      K::Point_2 low = merged.segment.source();
+      K::Point_2 high = merged.segment.target();
+      for (int k = first + 1; k < last; k++) {
+        const auto &s = entries[k].segment;
+        merged.length += entries[k].length < 0
+                             ? std::sqrt(CGAL::to_double(s.squared_length()))
+                             : entries[k].length;
+        for (const auto &p : {s.source(), s.target()}) {
+          if ((p - low) * d < 0) {
+            low = p;
+          }
+          if ((p - high) * d > 0) {
+            high = p;
+          }
         }
-        auto r = K::Ray_2(source, directional_vec);
-        record.intersect(r);
       }
+      merged.segment = K::Segment_2(low, high);
+    }
+    entries[n_entries++] = merged;
+    piece_offsets.push_back(pieces.size());
+    /* Skip the entries found from the other side */
+    first = last;
+    while (first < entries.size() &&
+           std::get<0>(key(entries[first])) == std::get<0>(key(merged)) &&
+           std::get<1>(key(entries[first])) == std::get<1>(key(merged))) {
+      first++;
+    }
+  }
+  entries.resize(n_entries);
 
-      if (not current_is_infinite && not next_is_infinite) {
-        debug_info = CURRENT_FINITE_NEXT_FINITE;
-        if (not is_inside[current_f] || not is_inside[current_f->neighbor(i)]) {
-          K::Segment_2 s = K::Segment_2(vertex_of_face[current_f],
-                                        vertex_of_face[current_f->neighbor(i)]);
-          record.intersect(s);
-        }
+  /* Entries are sorted, so that each row is sorted by neighbour index */
+  neighbour_offsets.assign(n + 1, 0);
+  for (auto &e : entries) {
+    neighbour_offsets[e.i + 1]++;
+    neighbour_offsets[e.j + 1]++;
+  }
+  for (int i = 0; i < n; i++) {
+    neighbour_offsets[i + 1] += neighbour_offsets[i];
+  }
+  neighbours.resize(2 * entries.size());
+  borders.resize(2 * entries.size());
+  border_lengths.resize(2 * entries.size());
+  std::vector<int> next(neighbour_offsets.begin(), neighbour_offsets.end() - 1);
+  std::vector<int> entry_of(2 * entries.size());
+  for (int e = 0; e < entries.size(); e++) {
+    const auto &entry = entries[e];
+    for (auto [i, j] :
+         {std::pair(entry.i, entry.j), std::pair(entry.j, entry.i)}) {
+      const int k = next[i]++;
+      neighbours[k] = j;
+      borders[k] = entry.segment;
+      border_lengths[k] = entry.length;
+      entry_of[k] = e;
+    }
+  }
+  border_piece_offsets.assign(neighbours.size() + 1, 0);
+  border_pieces.clear();
+  if (pieces.empty()) {
+    return;
+  }
+  for (int k = 0; k < neighbours.size(); k++) {
+    const int e = entry_of[k];
+    border_pieces.insert(border_pieces.end(),
+                         pieces.begin() + piece_offsets[e],
+                         pieces.begin() + piece_offsets[e + 1]);
+    border_piece_offsets[k + 1] = border_pieces.size();
+  }
+}
+
+void PowerDiagram::close_cell(crop_buffer &buffer, int index, int first) {
+  if (buffer.vertices.size() > first + 1 &&
+      buffer.vertices.back() == buffer.vertices[first]) {
+    buffer.vertices.pop_back();
+  }
+  const int n = buffer.vertices.size() - first;
+  if (n > 2) {
+    buffer.cells.push_back(index);
+    buffer.vertex_offsets.push_back(buffer.vertices.size());
+    /* Measure the cell while its vertices are still in cache */
+    buffer.moments.push_back(polygon_moments(&buffer.vertices[first], n));
+  } else {
+    buffer.vertices.resize(first);
+  }
+}
+
+bool PowerDiagram::face_is_inside(Face_handle f) const {
+  auto it = is_inside.find(f);
+  return it != is_inside.end() && it->second;
+}
+
+void PowerDiagram::crop_cell(Vertex_handle vh, crop_buffer &buffer) {
+  if (convex_support) {
+    clip_cell(vh, buffer);
+    return;
+  }
+  if (not support_index.is_empty()) {
+    cut_cell(vh, buffer);
+    return;
+  }
+
+  /* Start the rotation from a finite face around vh */
+  auto fc = dual_rt.incident_faces(vh);
+  while (dual_rt.is_infinite(fc)) {
+    ++fc;
+  }
+  Face_handle f = fc;
+  int i = Regular_triangulation::ccw(f->index(vh));
+
+  vertex v = vh->point();
+  const int index = vh->info();
+  auto current_f = f;
+  auto last_f = f;
+  chain cell_chain;
+
+  enum FACE_CASE debug_info;
+  RotationRecord record{cropped_shape, &debug_info};
+  bool should_complete_with_support = false;
+
+  do {
+    bool next_is_infinite = dual_rt.is_infinite(current_f->neighbor(i));
+    bool current_is_infinite = dual_rt.is_infinite(current_f);
+    bool vertex_inserted = false;
+    vertex next_v = current_f->vertex(Regular_triangulation::ccw(i))->point();
+
+    if (not current_is_infinite && face_is_inside(current_f)) {
+      auto vertex = vertex_of_face.at(current_f);
+      if (cell_chain.back() != vertex)
+        cell_chain.push_back(vertex);
+      /* std::cout << "Insert " << center[current_f] << std::endl; */
+      vertex_inserted = true;
+    }
+
+    if (current_is_infinite && next_is_infinite) {
+      debug_info = CURRENT_INFINITE_NEXT_INFINITE;
+    }
+
+    if (current_is_infinite != next_is_infinite) {
+      auto directional_vec = CGAL::Vector_2<K>(v.point(), next_v.point())
+                                 .perpendicular(CGAL::COUNTERCLOCKWISE);
+      K::Point_2 source;
+      if (next_is_infinite) {
+        debug_info = CURRENT_FINITE_NEXT_INFINITE;
+        source = vertex_of_face.at(current_f);
+      } else {
+        debug_info = CURRENT_INFINITE_NEXT_FINITE;
+        directional_vec = -directional_vec;
+        source = vertex_of_face.at(current_f->neighbor(i));
       }
+      auto r = K::Ray_2(source, directional_vec);
+      record.intersect(r);
+      buffer.n_tests += cropped_shape.size();
+    }
 
-      bool insert_next_vertex =
-          (not next_is_infinite) && is_inside[current_f->neighbor(i)];
-      if (vertex_inserted or insert_next_vertex or record.size() >= 2) {
-        K::Segment_2 edge = {v.point(), next_v.point()};
-        bool boder_exists = borders.contains(edge.opposite());
-
-        if (not boder_exists && record.size() == 1) {
-          auto p = record.points().front();
-          if (vertex_inserted) {
-            borders.insert({edge, K::Segment_2{vertex_of_face[current_f], p}});
-          } else if (insert_next_vertex) {
-            borders.insert(
-                {edge,
-                 K::Segment_2{p, vertex_of_face[current_f->neighbor(i)]}});
-          }
-        }
-        if (not boder_exists && vertex_inserted && insert_next_vertex &&
-            record.size() == 0) {
-          borders.insert(
-              {edge, K::Segment_2{vertex_of_face[current_f],
-                                  vertex_of_face[current_f->neighbor(i)]}});
-        }
+    if (not current_is_infinite && not next_is_infinite) {
+      debug_info = CURRENT_FINITE_NEXT_FINITE;
+      if (not face_is_inside(current_f) ||
+          not face_is_inside(current_f->neighbor(i))) {
+        K::Segment_2 s =
+            K::Segment_2(vertex_of_face.at(current_f),
+                         vertex_of_face.at(current_f->neighbor(i)));
+        record.intersect(s);
+        buffer.n_tests += cropped_shape.size();
+      }
+    }
 
-        if (not boder_exists && record.size() >= 2) {
-          /* Might need to deal with non-convex support, in which case */
-          /* the border is a chain of segments */
-          auto intersection_points = record.points();
-          if (intersection_points.size() > 2) {
-            std::cout << "We get more than 2 intersection points of type "
-                      << debug_info << ", this is not handled in current state."
-                      << std::endl;
-            std::exit(EXIT_FAILURE);
-          } else {
-            K::Segment_2 edge = {v.point(), next_v.point()};
-            borders.insert({edge, K::Segment_2{intersection_points.front(),
-                                               intersection_points.back()}});
-          }
+    bool insert_next_vertex =
+        (not next_is_infinite) && face_is_inside(current_f->neighbor(i));
+    if (vertex_inserted or insert_next_vertex or record.size() >= 2) {
+      const int next_index =
+          current_f->vertex(Regular_triangulation::ccw(i))->info();
+
+      if (record.size() == 1) {
+        auto p = record.points().front();
+        if (vertex_inserted) {
+          buffer.borders.push_back(
+              {index, next_index,
+               K::Segment_2{vertex_of_face.at(current_f), p}});
+        } else if (insert_next_vertex) {
+          buffer.borders.push_back(
+              {index, next_index,
+               K::Segment_2{p, vertex_of_face.at(current_f->neighbor(i))}});
         }
       }
+      if (vertex_inserted && insert_next_vertex && record.size() == 0) {
+        buffer.borders.push_back(
+            {index, next_index,
+             K::Segment_2{vertex_of_face.at(current_f),
+                          vertex_of_face.at(current_f->neighbor(i))}});
+      }
 
-      if (cell_chain.size() > 0) {
-        if (record.size() == 0 && not vertex_inserted) {
-          /* std::cout << "Walking outside the support." << std::endl; */
-          should_complete_with_support = true;
+      if (record.size() >= 2) {
+        /* Might need to deal with non-convex support, in which case */
+        /* the border is a chain of segments */
+        auto intersection_points = record.points();
+        if (intersection_points.size() > 2) {
+          std::cout << "We get more than 2 intersection points of type "
+                    << debug_info << ", this is not handled in current state."
+                    << std::endl;
+          std::exit(EXIT_FAILURE);
+        } else {
+          buffer.borders.push_back(
+              {index, next_index,
+               K::Segment_2{intersection_points.front(),
+                            intersection_points.back()}});
         }
+      }
+    }
 
-        if (not is_inside[current_f] && is_inside[current_f->neighbor(i)] &&
-            record.size() == 1) {
-          /* std::cout << "Entering the support." << std::endl; */
-          should_complete_with_support = true;
-        }
+    if (cell_chain.size() > 0) {
+      if (record.size() == 0 && not vertex_inserted) {
+        /* std::cout << "Walking outside the support." << std::endl; */
+        should_complete_with_support = true;
+      }
 
-        if (record.size() >= 2) {
-          /* std::cout << "Traversing the support." << std::endl; */
-          should_complete_with_support = true;
-        }
+      if (not face_is_inside(current_f) &&
+          face_is_inside(current_f->neighbor(i)) && record.size() == 1) {
+        /* std::cout << "Entering the support." << std::endl; */
+        should_complete_with_support = true;
       }
 
-      if (not is_inside[current_f]) {
-        record.fix_orientation(v, next_v);
+      if (record.size() >= 2) {
+        /* std::cout << "Traversing the support." << std::endl; */
+        should_complete_with_support = true;
       }
+    }
+
+    if (not face_is_inside(current_f)) {
+      record.fix_orientation(v, next_v);
+    }
 
-      record.complete(&cell_chain, should_complete_with_support);
+    record.complete(&cell_chain, should_complete_with_support);
 
-      /* Return back to the time we get the first intersection. */
-      last_f = current_f;
-      current_f = last_f->neighbor(i);
-      i = current_f->index(last_f);
-      i = Regular_triangulation::cw(i);
-    } while (current_f != f);
+    /* Return back to the time we get the first intersection. */
+    last_f = current_f;
+    current_f = last_f->neighbor(i);
+    i = current_f->index(last_f);
+    i = Regular_triangulation::cw(i);
+  } while (current_f != f);
 
-    record.seal(&cell_chain);
+  record.seal(&cell_chain);
 
-    if (cell_chain.size() > 2) {
-      auto cell_border = polygon(cell_chain.begin(), cell_chain.end());
-      cropped_cells.insert({v, cell_border});
-      /* std::cout << "Rotation cropping at " << v << " with " << cell_border */
-      /*           << std::endl; */
-    }
+  if (cell_chain.size() > 2) {
+    const int first = buffer.vertices.size();
+    buffer.vertices.insert(buffer.vertices.end(), cell_chain.begin(),
+                           cell_chain.end());
+    close_cell(buffer, index, first);
+    /* std::cout << "Rotation cropping at " << v << " with " */
+    /*           << polygon(cell_chain.begin(), cell_chain.end()) << std::endl; */
   }
 }
 
@@ -1,4 +1,5 @@
 #include <barycenter.hpp>
+#include <gsl/gsl_blas.h>
 #include <gsl/gsl_matrix.h>
 #include <gsl/gsl_vector.h>
 
@@ -28,47 +29,48 @@ int set_potential(WassersteinBarycenter *barycenter_problem,
   return GSL_SUCCESS;
 }
 
-int get_jacobian_uniform_measure(WassersteinBarycenter *barycenter_problem,
-                                 gsl_matrix *df) {
+/* Derivative of the mass of cell i with respect to the potential of its
+ * neighbour in the entry k of the partition adjacency */
+static double jacobian_entry(WassersteinBarycenter *barycenter_problem, int i,
+                             int k) {
+  const auto &partition = barycenter_problem->partition;
+  const int j = partition.neighbours[k];
+  K::Segment_2 s(partition.site(i).point(), partition.site(j).point());
+  double p = barycenter_problem->has_uniform_measure()
+                 ? partition.border_lengths[k] / barycenter_problem->support_area
+                 : barycenter_problem->border_masses[k];
+  return p / std::sqrt(CGAL::to_double(s.squared_length()));
+}
+
+static bool has_jacobian_data(WassersteinBarycenter *barycenter_problem) {
+  const auto &partition = barycenter_problem->partition;
+  return partition.number_of_sites() ==
+             barycenter_problem->valid_column_variables.size() &&
+         (barycenter_problem->has_uniform_measure() ||
+          barycenter_problem->border_masses.size() ==
+              partition.neighbours.size());
+}
+
+int get_jacobian(WassersteinBarycenter *barycenter_problem, gsl_matrix *df) {
+  scoped_timer timer(Jacobian);
   const std::vector<int> &variables =
       barycenter_problem->valid_column_variables;
   const int n_variables = variables.size();
-  auto &borders = barycenter_problem->partition.borders;
+  const auto &partition = barycenter_problem->partition;
   bool has_vertex_out_of_support = false;
-  for (int i = 0; i < n_variables; i++) {
-    for (int j = 0; j < n_variables; j++) {
-      if (j <= i) {
-        continue;
-      }
-      K::Segment_2 s(barycenter_problem->support_points[variables[i]],
-                     barycenter_problem->support_points[variables[j]]);
-      K::Segment_2 border{K::Point_2(0, 0), K::Point_2(0, 0)};
-      double p = 0;
-      bool has_border = true;
-      if (borders.contains(s)) {
-        border = borders[s];
-      } else if (borders.contains(s.opposite())) {
-        border = borders[s.opposite()];
-      } else {
-        has_border = false;
-      }
-      if (has_border) {
-        p = std::sqrt(
-                CGAL::to_double(border.squared_length() / s.squared_length())) /
-            barycenter_problem->support_area;
-      }
-      gsl_matrix_set(df, i, j, p);
-      gsl_matrix_set(df, j, i, p);
-    }
+  /* The partition is indexed in the order of valid column variables */
+  if (not has_jacobian_data(barycenter_problem)) {
+    return GSL_FAILURE;
   }
-
+  gsl_matrix_set_zero(df);
   for (int i = 0; i < n_variables; i++) {
     double sum = 0;
-    for (int j = 0; j < n_variables; j++) {
-      if (j == i) {
-        continue;
-      }
-      sum += gsl_matrix_get(df, i, j);
+    for (int k = partition.neighbour_offsets[i];
+         k < partition.neighbour_offsets[i + 1]; k++) {
+      const int j = partition.neighbours[k];
+      const double p = jacobian_entry(barycenter_problem, i, k);
+      gsl_matrix_set(df, i, j, p);
+      sum += p;
     }
     gsl_matrix_set(df, i, i, -sum);
     if (sum == 0) {
@@ -82,12 +84,12 @@ int get_jacobian_uniform_measure(WassersteinBarycenter *barycenter_problem,
   }
 }
 
-int get_jacobian_uniform_measure_lower_dimension(
-    WassersteinBarycenter *barycenter_problem, gsl_matrix *J) {
+int get_jacobian_lower_dimension(WassersteinBarycenter *barycenter_problem,
+                                 gsl_matrix *J) {
 
   const int n = barycenter_problem->valid_column_variables.size();
-  gsl_matrix *jacobian = gsl_matrix_alloc(n, n);
-  int state = get_jacobian_uniform_measure(barycenter_problem, jacobian);
+  gsl_matrix *jacobian = barycenter_problem->workspace.dense_jacobian(n);
+  int state = get_jacobian(barycenter_problem, jacobian);
   if (state == GSL_SUCCESS) {
     for (int i = 0; i < n - 1; i++) {
       for (int j = 0; j < n - 1; j++) {
@@ -100,6 +102,92 @@ int get_jacobian_uniform_measure_lower_dimension(
   }
 }
 
+int get_sparse_jacobian(WassersteinBarycenter *barycenter_problem,
+                        SparseLaplacian &L) {
+  scoped_timer timer(Jacobian);
+  const auto &partition = barycenter_problem->partition;
+  const int n = barycenter_problem->valid_column_variables.size() - 1;
+  L.clear();
+  if (not has_jacobian_data(barycenter_problem)) {
+    return GSL_FAILURE;
+  }
+  bool has_vertex_out_of_support = false;
+  for (int i = 0; i < n; i++) {
+    double sum = 0;
+    for (int k = partition.neighbour_offsets[i];
+         k < partition.neighbour_offsets[i + 1]; k++) {
+      const int j = partition.neighbours[k];
+      const double p = jacobian_entry(barycenter_problem, i, k);
+      if (j < n) {
+        L.add_entry(j, -p);
+      }
+      sum += p;
+    }
+    L.close_row(sum);
+    if (sum == 0) {
+      has_vertex_out_of_support = true;
+    }
+  }
+  return has_vertex_out_of_support ? GSL_FAILURE : GSL_SUCCESS;
+}
+
+int get_jacobian_diagonal(WassersteinBarycenter *barycenter_problem,
+                          std::vector<double> &diagonal) {
+  scoped_timer timer(Jacobian);
+  const auto &partition = barycenter_problem->partition;
+  const int n = barycenter_problem->valid_column_variables.size() - 1;
+  diagonal.assign(n, 0);
+  if (not has_jacobian_data(barycenter_problem)) {
+    return GSL_FAILURE;
+  }
+  for (int i = 0; i < n; i++) {
+    for (int k = partition.neighbour_offsets[i];
+         k < partition.neighbour_offsets[i + 1]; k++) {
+      diagonal[i] += jacobian_entry(barycenter_problem, i, k);
+    }
+    if (diagonal[i] == 0) {
+      return GSL_FAILURE;
+    }
+  }
+  return GSL_SUCCESS;
+}
+
+static constexpr int min_rows_per_thread = 4096;
+
+void jacobian_product(WassersteinBarycenter *barycenter_problem,
+                      const std::vector<double> &diagonal,
+                      const std::vector<double> &x, std::vector<double> &y) {
+  const auto &partition = barycenter_problem->partition;
+  const int n = diagonal.size();
+  y.resize(n);
+  auto work = [&](int first, int last) {
+    for (int i = first; i < last; i++) {
+      double sum = diagonal[i] * x[i];
+      for (int k = partition.neighbour_offsets[i];
+           k < partition.neighbour_offsets[i + 1]; k++) {
+        const int j = partition.neighbours[k];
+        if (j < n) {
+          sum -= jacobian_entry(barycenter_problem, i, k) * x[j];
+        }
+      }
+      y[i] = sum;
+    }
+  };
+
+  /* Rows are independent, each worker computes a contiguous range. A
+   * product is run at every iteration of the conjugate gradient, so the
+   * workers are kept by the workspace instead of started every time. */
+  const int n_workers =
+      std::max(1, std::min(partition.n_threads, n / min_rows_per_thread));
+  if (n_workers == 1) {
+    work(0, n);
+    return;
+  }
+  barycenter_problem->workspace.workers.run(n_workers, [&](int w) {
+    work(n * w / n_workers, n * (w + 1) / n_workers);
+  });
+}
+
 int gradient_fn(const gsl_vector *x, void *p, gsl_vector *f) {
   WassersteinBarycenter *barycenter_problem = (WassersteinBarycenter *)p;
   int state = set_potential(barycenter_problem, x);
@@ -111,12 +199,12 @@ int gradient_fn(const gsl_vector *x, void *p, gsl_vector *f) {
   }
 }
 
-int jacobian_uniform_measure(const gsl_vector *x, void *p, gsl_matrix *df) {
+int jacobian_fn(const gsl_vector *x, void *p, gsl_matrix *df) {
   WassersteinBarycenter *barycenter_problem = (WassersteinBarycenter *)p;
   int state = set_potential(barycenter_problem, x);
   if (state == GSL_SUCCESS) {
     state =
-        get_jacobian_uniform_measure_lower_dimension(barycenter_problem, df);
+        get_jacobian_lower_dimension(barycenter_problem, df);
     return state;
   } else {
     return GSL_FAILURE;
@@ -129,56 +217,148 @@ int composite_fdf(const gsl_vector *x, void *p, gsl_vector *f, gsl_matrix *df) {
   if (state == GSL_SUCCESS) {
     get_gradient(barycenter_problem, f);
     state =
-        get_jacobian_uniform_measure_lower_dimension(barycenter_problem, df);
+        get_jacobian_lower_dimension(barycenter_problem, df);
     return state;
   } else {
     return GSL_FAILURE;
   }
 }
 
+bool WassersteinBarycenter::warm_start_potential() {
+  if (not use_warm_start || cached_semi_discrete_solution.empty()) {
+    return false;
+  }
+  /* Both lists of variables are sorted, count their symmetric difference */
+  auto distance = [](const std::vector<int> &a, const std::vector<int> &b) {
+    int d = 0;
+    auto ait = a.begin();
+    auto bit = b.begin();
+    while (ait != a.end() && bit != b.end()) {
+      if (*ait < *bit) {
+        d++;
+        ++ait;
+      } else if (*bit < *ait) {
+        d++;
+        ++bit;
+      } else {
+        ++ait;
+        ++bit;
+      }
+    }
+    return d + int(a.end() - ait) + int(b.end() - bit);
+  };
+  auto nearest = cached_semi_discrete_solution.begin();
+  int nearest_distance = std::numeric_limits<int>::max();
+  for (auto cit = cached_semi_discrete_solution.begin();
+       cit != cached_semi_discrete_solution.end(); ++cit) {
+    const int d = distance(cit->first, valid_column_variables);
+    if (d < nearest_distance) {
+      nearest_distance = d;
+      nearest = cit;
+    }
+  }
+  if (nearest->second.potential.size() != n_column_variables + 1) {
+    return false;
+  }
+
+  /* The cached potential was extended to every column variable, so that the
+   * cells of the inactive ones just vanish. Newly active variables get a
+   * weight increment of the order of their mass to start with a cell. */
+  potential = nearest->second.potential;
+  for (int j : valid_column_variables) {
+    if (not std::binary_search(nearest->first.begin(), nearest->first.end(),
+                               j)) {
+      potential[j] += discrete_plan[j] * support_area;
+    }
+  }
+  std::cout << "Warm start from a cached lp vertex at distance "
+            << nearest_distance << "." << std::endl;
+  return true;
+}
+
 int WassersteinBarycenter::semi_discrete_iteration(int steps) {
 
-  /* We only deal with uniform measure for now */
-  if (valid_column_variables.size() < 2 || not is_uniform_measure) {
+  if (valid_column_variables.size() < 2) {
+    error = 0;
     return 0;
   }
 
-  gsl_multiroot_function_fdf FDF;
-  FDF.f = &gradient_fn;
-  FDF.df = &jacobian_uniform_measure;
-  FDF.fdf = &composite_fdf;
-
   /* lower one dimension to get more stable result */
-  FDF.n = valid_column_variables.size() - 1;
-  FDF.params = this;
-  gsl_vector *x = gsl_vector_alloc(FDF.n);
-  int index_of_maximun_proba = FDF.n;
+  const int n = valid_column_variables.size() - 1;
+  int index_of_maximun_proba = n;
 
   const auto backup_vars = valid_column_variables;
-  const auto backup_dumb_vars = dumb_column_variables;
   std::sort(
       valid_column_variables.begin(), valid_column_variables.end(),
       [this](int a, int b) { return discrete_plan[a] < discrete_plan[b]; });
 
-  if (index_of_maximun_proba < FDF.n) {
+  if (index_of_maximun_proba < n) {
     int tmp = valid_column_variables[index_of_maximun_proba];
-    valid_column_variables[index_of_maximun_proba] =
-        valid_column_variables[FDF.n];
-    valid_column_variables[FDF.n] = tmp;
+    valid_column_variables[index_of_maximun_proba] = valid_column_variables[n];
+    valid_column_variables[n] = tmp;
+  }
+
+  if (use_multiscale) {
+    solve_coarse_levels(steps);
+  }
+  if (lbfgs_steps > 0) {
+    lbfgs_iteration(lbfgs_steps);
+  }
+  const int iter = use_sparse_newton ? sparse_newton_iteration(steps)
+                                     : gsl_newton_iteration(steps);
+
+  error = 0;
+  for (int i = 0; i < n + 1; i++) {
+    error += std::abs(gradient[valid_column_variables[i]]);
+  }
+
+  if (not has_converged()) {
+    std::cout << "Fail to solve a semi-discrete problem within required "
+                 "error after "
+              << (iter < 0 ? steps : iter) << " iterations with error "
+              << error << "." << std::endl;
+  }
+
+  valid_column_variables = backup_vars;
+  return iter;
+}
+
+/* Halve the last step dx, which was added to the potentials, until every cell
+ * exists again */
+void WassersteinBarycenter::restore_cells(const double *dx, int stride) {
+  const int n = valid_column_variables.size() - 1;
+  double fraction = 1;
+  while (partition.number_of_cells() < n + 1) {
+    fraction /= 2;
+    for (int i = 0; i < n; i++) {
+      potential[valid_column_variables[i]] -= fraction * dx[i * stride];
+    }
+    update_partition_and_gradient();
   }
+}
+
+int WassersteinBarycenter::gsl_newton_iteration(int steps) {
+  gsl_multiroot_function_fdf FDF;
+  FDF.f = &gradient_fn;
+  FDF.df = &jacobian_fn;
+  FDF.fdf = &composite_fdf;
+  FDF.n = valid_column_variables.size() - 1;
+  FDF.params = this;
+  gsl_vector *x = workspace.gsl_potential(FDF.n);
 
   for (int i = 0; i < FDF.n; i++) {
     gsl_vector_set(x, i, potential[valid_column_variables[i]]);
   }
 
-  const gsl_multiroot_fdfsolver_type *T = gsl_multiroot_fdfsolver_newton;
-  semi_discrete_newton = gsl_multiroot_fdfsolver_alloc(T, FDF.n);
+  gsl_multiroot_fdfsolver *semi_discrete_newton =
+      workspace.newton_solver(FDF.n);
   gsl_multiroot_fdfsolver_set(semi_discrete_newton, &FDF, x);
 
   int status = 0;
   int iter = 0;
   do {
     iter++;
+    Trace::global().count(NewtonIterations);
     status = gsl_multiroot_fdfsolver_iterate(semi_discrete_newton);
 
     if (status == GSL_EBADFUNC) {
@@ -186,22 +366,15 @@ int WassersteinBarycenter::semi_discrete_iteration(int steps) {
       /*              "function or its derivative evaluated to Inf or NaN." */
       /*           << std::endl; */
 
-      double fraction = 1;
-      while (partition.cropped_cells.size() < FDF.n + 1) {
-        fraction /= 2;
-        for (int i = 0; i < FDF.n; i++) {
-          potential[valid_column_variables[i]] -=
-              fraction * gsl_vector_get(semi_discrete_newton->dx, i);
-        }
-        update_partition_and_gradient();
-      }
+      restore_cells(semi_discrete_newton->dx->data,
+                    semi_discrete_newton->dx->stride);
 
       for (int i = 0; i < FDF.n; i++) {
         gsl_vector_set(semi_discrete_newton->x, i,
                        potential[valid_column_variables[i]]);
       }
       get_gradient(this, semi_discrete_newton->f);
-      int adjust_state = get_jacobian_uniform_measure_lower_dimension(
+      int adjust_state = get_jacobian_lower_dimension(
           this, semi_discrete_newton->J);
       if (adjust_state == GSL_FAILURE) {
         std::cout << "Manual adjustment failed." << std::endl;
@@ -218,25 +391,134 @@ int WassersteinBarycenter::semi_discrete_iteration(int steps) {
 
     status =
         gsl_multiroot_test_residual(semi_discrete_newton->f, 0.1 * tolerance);
+    Trace::global().write(
+        Inner, "newton",
+        {{"iteration", iter},
+         {"residual", gsl_blas_dasum(semi_discrete_newton->f)}});
   } while (status == GSL_CONTINUE && iter < steps);
 
-  error = 0;
-  for (int i = 0; i < FDF.n + 1; i++) {
-    double p = potential[valid_column_variables[i]];
-    error += std::abs(gradient[valid_column_variables[i]]);
+  return iter;
+}
+
+/* The operator is the opposite of the Jacobian J, so that the Newton step
+ * dx = -J^{-1} f solves it with the residual f as right-hand side. */
+bool WassersteinBarycenter::solve_newton_step() {
+  const int n = workspace.residual.size();
+  int state;
+  if (use_matrix_free) {
+    state = get_jacobian_diagonal(this, workspace.diagonal);
+  } else {
+    state = get_sparse_jacobian(this, workspace.sparse_jacobian);
   }
+  if (state == GSL_FAILURE) {
+    std::cout << "The Jacobian of the semi-discrete problem is singular."
+              << std::endl;
+    return false;
+  }
+  workspace.direction.assign(n, 0);
+  scoped_timer timer(LinearSolve);
+  int iterations;
+  if (use_matrix_free) {
+    iterations = conjugate_gradient(
+        [this](const std::vector<double> &x, std::vector<double> &y) {
+          jacobian_product(this, workspace.diagonal, x, y);
+        },
+        workspace.diagonal, workspace.residual, workspace.direction,
+        workspace.cg);
+  } else {
+    iterations = workspace.sparse_jacobian.solve(workspace.residual,
+                                                 workspace.direction);
+  }
+  if (iterations < 0) {
+    std::cout << "Conjugate gradient failed to solve the Newton step."
+              << std::endl;
+    return false;
+  }
+  return true;
+}
 
-  gsl_vector_free(x);
+/* Damped Newton steps solved by conjugate gradient on the sparse Jacobian,
+ * which is assembled from the adjacency of the partition. A step is halved
+ * until every cell keeps a minimum mass and the residual decreases enough,
+ * as in Kitagawa, Merigot and Thibert, so the partition never loses a cell.
+ * Return the number of iterations, or -1 when a step cannot be solved or no
+ * damped step decreases the residual. */
+int WassersteinBarycenter::sparse_newton_iteration(int steps) {
+  const int n = valid_column_variables.size() - 1;
+  workspace.residual.resize(n);
+  workspace.potential.resize(n);
+  update_partition_and_gradient();
 
-  if (iter == steps) {
-    std::cout << "Fail to solve a semi-discrete problem within required "
-                 "error after "
-              << iter << " iterations with error " << error << "." << std::endl;
-    dump_debug();
+  /* Smallest cell mass and Euclidean norm of the gradient */
+  auto smallest_mass = [this, n]() {
+    double mass = std::numeric_limits<double>::max();
+    for (int i = 0; i <= n; i++) {
+      const int j = valid_column_variables[i];
+      mass = std::min(mass, discrete_plan[j] - gradient[j]);
+    }
+    return mass;
+  };
+  auto gradient_norm = [this, n]() {
+    double norm = 0;
+    for (int i = 0; i <= n; i++) {
+      norm += std::pow(gradient[valid_column_variables[i]], 2);
+    }
+    return std::sqrt(norm);
+  };
+  double min_mass = smallest_mass();
+  for (int i = 0; i <= n; i++) {
+    min_mass = std::min(min_mass, discrete_plan[valid_column_variables[i]]);
   }
+  min_mass = std::max(0.5 * min_mass, 0.0);
+  double norm = gradient_norm();
+  auto has_converged = [this, n]() {
+    double residual = 0;
+    for (int i = 0; i < n; i++) {
+      residual += std::abs(gradient[valid_column_variables[i]]);
+    }
+    return residual < 0.1 * tolerance;
+  };
 
-  valid_column_variables = backup_vars;
-  dumb_column_variables = backup_dumb_vars;
+  int iter = 0;
+  while (iter < steps && not has_converged()) {
+    iter++;
+    Trace::global().count(NewtonIterations);
+    for (int i = 0; i < n; i++) {
+      workspace.residual[i] = gradient[valid_column_variables[i]];
+      workspace.potential[i] = potential[valid_column_variables[i]];
+    }
+    if (not solve_newton_step()) {
+      return -1;
+    }
+
+    double step = 1;
+    bool accepted = false;
+    while (step >= min_newton_step) {
+      for (int i = 0; i < n; i++) {
+        potential[valid_column_variables[i]] =
+            workspace.potential[i] + step * workspace.direction[i];
+      }
+      update_partition_and_gradient();
+      const double next_norm = gradient_norm();
+      if (smallest_mass() >= min_mass && next_norm <= (1 - step / 2) * norm) {
+        norm = next_norm;
+        accepted = true;
+        break;
+      }
+      step /= 2;
+    }
+    if (not accepted) {
+      for (int i = 0; i < n; i++) {
+        potential[valid_column_variables[i]] = workspace.potential[i];
+      }
+      update_partition_and_gradient();
+      std::cout << "The damped Newton step found no descent after "
+                << iter << " iterations." << std::endl;
+      return -1;
+    }
+    Trace::global().write(Inner, "newton",
+                          {{"iteration", iter}, {"step", step}, {"norm", norm}});
+  }
   return iter;
 }
 
@@ -244,7 +526,7 @@ void WassersteinBarycenter::dump_semi_discrete_solver() {
   const int n = valid_column_variables.size();
   gsl_matrix *jacobian = gsl_matrix_alloc(n, n);
   std::ofstream file("data/jacobian");
-  get_jacobian_uniform_measure(this, jacobian);
+  get_jacobian(this, jacobian);
   std::cout << "Matrix data is written to file data/jacobian." << std::endl;
   if (n < 10) {
     std::cout << "Current jacobian is:" << std::endl;
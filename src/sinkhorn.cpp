@@ -0,0 +1,121 @@
+#include <barycenter.hpp>
+
+/* Entropic transport from a grid sampling the support measure to the
+ * points of the valid column variables, by log-domain Sinkhorn iterations
+ * with a decreasing regularization. The dual potentials of the points are
+ * the weights of the power diagram that approximately solves the
+ * semi-discrete problem. The grid has at most sinkhorn_max_samples squares,
+ * since every iteration goes over all the pairs of samples and points. */
+void WassersteinBarycenter::sinkhorn_potential() {
+  if (support_measure == Density) {
+    std::cout << "Sinkhorn seeding needs pointwise values of the support "
+                 "measure, skipped for a density."
+              << std::endl;
+    return;
+  }
+  if (not(sinkhorn_scaling > 0 && sinkhorn_scaling < 1)) {
+    std::cerr << "Invalid Sinkhorn scaling " << sinkhorn_scaling << "."
+              << std::endl;
+    return;
+  }
+  const int n = valid_column_variables.size();
+  const auto box = support_polygon.bbox();
+  const double box_area =
+      (box.xmax() - box.xmin()) * (box.ymax() - box.ymin());
+  const int n_target = std::clamp(sinkhorn_points_per_cell * n, 16,
+                                  std::max(sinkhorn_max_samples, 16));
+  const double h = std::sqrt(box_area / n_target);
+
+  /* Centers of the grid squares inside the support */
+  std::vector<double> x_s, y_s, log_a;
+  double total = 0;
+  for (double y = box.ymin() + 0.5 * h; y < box.ymax(); y += h) {
+    for (double x = box.xmin() + 0.5 * h; x < box.xmax(); x += h) {
+      if (support_polygon.bounded_side(K::Point_2(x, y)) ==
+          CGAL::ON_UNBOUNDED_SIDE) {
+        continue;
+      }
+      const double a = support_measure == Raster ? raster.value(x, y) : 1;
+      if (a > 0) {
+        x_s.push_back(x);
+        y_s.push_back(y);
+        log_a.push_back(a);
+        total += a;
+      }
+    }
+  }
+  const int m = x_s.size();
+  if (m == 0) {
+    return;
+  }
+  for (double &a : log_a) {
+    a = std::log(a / total);
+  }
+
+  std::vector<double> x_t(n), y_t(n), log_b(n);
+  double plan_total = 0;
+  for (int i = 0; i < n; i++) {
+    plan_total += discrete_plan[valid_column_variables[i]];
+  }
+  for (int i = 0; i < n; i++) {
+    const int j = valid_column_variables[i];
+    x_t[i] = CGAL::to_double(support_point(j).x());
+    y_t[i] = CGAL::to_double(support_point(j).y());
+    log_b[i] = std::log(discrete_plan[j] / plan_total);
+  }
+
+  /* f(x) = -eps log sum_i b_i exp((g_i - c(x, y_i)) / eps), and the same for
+   * g, each sum being stabilized by its largest exponent. */
+  std::vector<double> f(m, 0), g(n, 0), exponent(std::max(m, n));
+  auto soft_min = [&exponent](int size, double eps) {
+    double largest = -std::numeric_limits<double>::max();
+    for (int k = 0; k < size; k++) {
+      largest = std::max(largest, exponent[k]);
+    }
+    double sum = 0;
+    for (int k = 0; k < size; k++) {
+      sum += std::exp((exponent[k] - largest) / eps);
+    }
+    return -(largest + eps * std::log(sum));
+  };
+
+  const double diameter_2 = std::pow(box.xmax() - box.xmin(), 2) +
+                            std::pow(box.ymax() - box.ymin(), 2);
+  /* Each level costs sinkhorn_iterations passes over the m n pairs, so
+   * start close enough to the final regularization to keep at most
+   * sinkhorn_max_levels of them. */
+  const double eps_final = h * h;
+  const int levels = std::max(sinkhorn_max_levels, 1);
+  const double eps_start =
+      std::min(diameter_2, eps_final * std::pow(sinkhorn_scaling, 1 - levels));
+  for (double eps = eps_start;;
+       eps = std::max(eps * sinkhorn_scaling, eps_final)) {
+    for (int iteration = 0; iteration < sinkhorn_iterations; iteration++) {
+      for (int s = 0; s < m; s++) {
+        for (int i = 0; i < n; i++) {
+          const double d_x = x_s[s] - x_t[i];
+          const double d_y = y_s[s] - y_t[i];
+          exponent[i] = g[i] + eps * log_b[i] - (d_x * d_x + d_y * d_y);
+        }
+        f[s] = soft_min(n, eps);
+      }
+      for (int i = 0; i < n; i++) {
+        for (int s = 0; s < m; s++) {
+          const double d_x = x_s[s] - x_t[i];
+          const double d_y = y_s[s] - y_t[i];
+          exponent[s] = f[s] + eps * log_a[s] - (d_x * d_x + d_y * d_y);
+        }
+        g[i] = soft_min(m, eps);
+      }
+    }
+    if (eps == eps_final) {
+      break;
+    }
+  }
+
+  for (int i = 0; i < n; i++) {
+    potential[valid_column_variables[i]] = g[i];
+  }
+  std::cout << "Seeded the potential by Sinkhorn iterations on " << m
+            << " samples of the support measure." << std::endl;
+}
@@ -0,0 +1,260 @@
+#include <barycenter.hpp>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char store_magic[8] = {'B', 'A', 'R', 'Y', 'S', 'O', 'L', '2'};
+
+struct record_header {
+  uint64_t fingerprint;
+  uint32_t n_columns;
+  uint32_t n_values;
+  double error;
+};
+
+/* Records as written by append, other headers are corrupted data */
+static bool is_valid(const record_header &header) {
+  return header.n_columns > 0 && header.n_columns < header.n_values &&
+         header.error >= 0;
+}
+
+void SolutionStore::unmap() {
+  if (data) {
+    munmap(const_cast<char *>(data), data_size);
+    data = nullptr;
+    data_size = 0;
+  }
+}
+
+void SolutionStore::close() {
+  unmap();
+  if (fd >= 0) {
+    ::close(fd);
+    fd = -1;
+  }
+}
+
+bool SolutionStore::open(const std::string &filename, uint64_t key, int n) {
+  close();
+  offsets.clear();
+  fingerprint = key;
+  n_values = n;
+
+  fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+  if (fd < 0) {
+    std::cerr << "Cannot open solution store " << filename << "." << std::endl;
+    return false;
+  }
+  /* Other runs sharing the file append whole records under the same lock */
+  flock(fd, LOCK_EX);
+  const bool indexed = index(filename);
+  flock(fd, LOCK_UN);
+  if (not indexed) {
+    close();
+  }
+  return indexed;
+}
+
+bool SolutionStore::index(const std::string &filename) {
+  struct stat status;
+  if (fstat(fd, &status) != 0) {
+    std::cerr << "Cannot read solution store " << filename << "." << std::endl;
+    return false;
+  }
+  if (status.st_size == 0) {
+    if (::write(fd, store_magic, sizeof(store_magic)) != sizeof(store_magic)) {
+      std::cerr << "Cannot write solution store " << filename << "."
+                << std::endl;
+      return false;
+    }
+    return true;
+  }
+  data_size = status.st_size;
+  void *mapping = mmap(nullptr, data_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (mapping == MAP_FAILED) {
+    data_size = 0;
+    std::cerr << "Cannot map solution store " << filename << "." << std::endl;
+    return false;
+  }
+  data = static_cast<const char *>(mapping);
+  if (data_size < sizeof(store_magic) ||
+      std::memcmp(data, store_magic, sizeof(store_magic)) != 0) {
+    std::cerr << filename << " is not a solution store." << std::endl;
+    return false;
+  }
+
+  /* A run killed while appending may have left a partial record at the end,
+   * shorter than its header and the payload it declares, which is cut off.
+   * Any other inconsistency is corrupted data, which is kept as is. */
+  size_t offset = sizeof(store_magic);
+  while (offset < data_size) {
+    record_header header;
+    if (offset + sizeof(header) > data_size) {
+      break;
+    }
+    std::memcpy(&header, data + offset, sizeof(header));
+    const size_t record_size =
+        sizeof(header) + header.n_columns * sizeof(int32_t) +
+        (header.n_columns + header.n_values) * sizeof(double);
+    if (not is_valid(header)) {
+      std::cerr << "Corrupted record at byte " << offset
+                << " of solution store " << filename << "." << std::endl;
+      return false;
+    }
+    if (offset + record_size > data_size) {
+      break;
+    }
+    if (header.fingerprint == fingerprint && header.n_values == n_values) {
+      std::vector<int> columns(header.n_columns);
+      const char *column_data = data + offset + sizeof(header);
+      for (int k = 0; k < columns.size(); k++) {
+        int32_t j;
+        std::memcpy(&j, column_data + k * sizeof(j), sizeof(j));
+        columns[k] = j;
+      }
+      offsets[columns] = offset;
+    }
+    offset += record_size;
+  }
+  if (offset < data_size) {
+    if (ftruncate(fd, offset) != 0) {
+      std::cerr << "Cannot cut the partial record of solution store "
+                << filename << "." << std::endl;
+      return false;
+    }
+    std::cout << "Cut a partial record of " << data_size - offset
+              << " bytes from solution store " << filename << "." << std::endl;
+  }
+  return true;
+}
+
+bool SolutionStore::find(const std::vector<int> &columns, double max_error,
+                         SparsePlan &plan, std::vector<double> &potential,
+                         double &error) const {
+  auto oit = offsets.find(columns);
+  if (oit == offsets.end()) {
+    return false;
+  }
+  record_header header;
+  const char *record = data + oit->second;
+  std::memcpy(&header, record, sizeof(header));
+  if (not(header.error < max_error)) {
+    return false;
+  }
+  const char *values =
+      record + sizeof(header) + header.n_columns * sizeof(int32_t);
+  std::vector<std::pair<int, double>> entries(columns.size());
+  for (int k = 0; k < columns.size(); k++) {
+    entries[k].first = columns[k];
+    std::memcpy(&entries[k].second, values + k * sizeof(double),
+                sizeof(double));
+  }
+  plan.assign(entries);
+  potential.resize(n_values);
+  std::memcpy(potential.data(), values + columns.size() * sizeof(double),
+              n_values * sizeof(double));
+  error = header.error;
+  return true;
+}
+
+void SolutionStore::append(const std::vector<int> &columns,
+                           const SparsePlan &plan,
+                           const std::vector<double> &potential,
+                           double error) {
+  if (not is_open() || potential.size() != n_values) {
+    return;
+  }
+  const record_header header{fingerprint, uint32_t(columns.size()),
+                             uint32_t(n_values), error};
+  record.clear();
+  auto put = [this](const void *bytes, size_t size) {
+    const char *begin = static_cast<const char *>(bytes);
+    record.insert(record.end(), begin, begin + size);
+  };
+  put(&header, sizeof(header));
+  for (int j : columns) {
+    const int32_t k = j;
+    put(&k, sizeof(k));
+  }
+  for (int j : columns) {
+    const double mass = plan[j];
+    put(&mass, sizeof(mass));
+  }
+  put(potential.data(), n_values * sizeof(double));
+  /* A single write under the lock, so that no other run sees a partial
+   * record unless this one is killed */
+  flock(fd, LOCK_EX);
+  const ssize_t written = ::write(fd, record.data(), record.size());
+  flock(fd, LOCK_UN);
+  if (written != record.size()) {
+    std::cerr << "Cannot append to the solution store." << std::endl;
+  }
+}
+
+/* Everything the semi-discrete solutions depend on, except the valid column
+ * variables: the marginals and their coefficients, the support and its
+ * measure. */
+uint64_t WassersteinBarycenter::problem_fingerprint() const {
+  Fingerprint f;
+  f.add(int64_t(marginals.size()));
+  for (const auto &marginal : marginals) {
+    f.add(int64_t(marginal.size()));
+    for (const auto &[point, mass] : marginal) {
+      f.add(CGAL::to_double(point.x()));
+      f.add(CGAL::to_double(point.y()));
+      f.add(mass);
+    }
+  }
+  for (double coef : marginal_coefficients) {
+    f.add(coef);
+  }
+  f.add(int64_t(crop_style));
+  if (crop_style == Polygon) {
+    for (const auto &p : support_polygon.vertices()) {
+      f.add(CGAL::to_double(p.x()));
+      f.add(CGAL::to_double(p.y()));
+    }
+  } else {
+    for (int i = 0; i < 4; i++) {
+      f.add(CGAL::to_double(support_box[i].x()));
+      f.add(CGAL::to_double(support_box[i].y()));
+    }
+  }
+  f.add(int64_t(support_measure));
+  if (support_measure == Raster) {
+    f.add(int64_t(raster.columns()));
+    f.add(int64_t(raster.rows()));
+    for (double x : raster.extent()) {
+      f.add(x);
+    }
+    for (double p : raster.pixel_values()) {
+      f.add(p);
+    }
+  }
+  return f.value();
+}
+
+void WassersteinBarycenter::open_solution_store() {
+  if (solution_store_file.empty()) {
+    if (const char *filename = std::getenv("BARYCENTER_CACHE")) {
+      solution_store_file = filename;
+    } else {
+      return;
+    }
+  }
+  if (support_measure == Density) {
+    std::cout << "Solutions for a density given by a function are not "
+                 "stored, its values cannot be fingerprinted."
+              << std::endl;
+    return;
+  }
+  if (solution_store.open(solution_store_file, problem_fingerprint(),
+                          n_column_variables + 1)) {
+    std::cout << "Found " << solution_store.size()
+              << " stored semi-discrete solutions of this problem in "
+              << solution_store_file << "." << std::endl;
+  }
+}
@@ -0,0 +1,79 @@
+#include "solver-workspace.hpp"
+
+SolverWorkspace::~SolverWorkspace() {
+  if (solver) {
+    gsl_multiroot_fdfsolver_free(solver);
+  }
+  if (potential_vector) {
+    gsl_vector_free(potential_vector);
+  }
+  if (jacobian_matrix) {
+    gsl_matrix_free(jacobian_matrix);
+  }
+  if (jacobian_block) {
+    gsl_block_free(jacobian_block);
+  }
+}
+
+gsl_matrix *SolverWorkspace::dense_jacobian(int n) {
+  if (jacobian_matrix && jacobian_matrix->size1 == n) {
+    return jacobian_matrix;
+  }
+  if (jacobian_matrix) {
+    /* The matrix does not own the block */
+    gsl_matrix_free(jacobian_matrix);
+  }
+  if (not jacobian_block || jacobian_block->size < size_t(n) * n) {
+    if (jacobian_block) {
+      gsl_block_free(jacobian_block);
+    }
+    jacobian_block = gsl_block_alloc(size_t(n) * n);
+  }
+  jacobian_matrix = gsl_matrix_alloc_from_block(jacobian_block, 0, n, n, n);
+  return jacobian_matrix;
+}
+
+gsl_vector *SolverWorkspace::gsl_potential(int n) {
+  if (not potential_vector || potential_vector->size != n) {
+    if (potential_vector) {
+      gsl_vector_free(potential_vector);
+    }
+    potential_vector = gsl_vector_alloc(n);
+  }
+  return potential_vector;
+}
+
+gsl_multiroot_fdfsolver *SolverWorkspace::newton_solver(int n) {
+  if (not solver || solver->x->size != n) {
+    if (solver) {
+      gsl_multiroot_fdfsolver_free(solver);
+    }
+    solver = gsl_multiroot_fdfsolver_alloc(gsl_multiroot_fdfsolver_newton, n);
+  }
+  return solver;
+}
+
+size_t SolverWorkspace::memory_footprint() const {
+  auto bytes = [](const auto &v) {
+    return v.capacity() * sizeof(typename std::decay_t<decltype(v)>::value_type);
+  };
+  size_t total = sizeof(*this);
+  if (jacobian_block) {
+    total += jacobian_block->size * sizeof(double);
+  }
+  if (potential_vector) {
+    total += potential_vector->size * sizeof(double);
+  }
+  if (solver) {
+    /* Jacobian, its LU factorization and five vectors */
+    const size_t n = solver->x->size;
+    total += (2 * n * n + 5 * n) * sizeof(double);
+  }
+  total += bytes(sparse_jacobian.diagonal) + bytes(sparse_jacobian.offsets) +
+           bytes(sparse_jacobian.columns) + bytes(sparse_jacobian.values);
+  total += bytes(diagonal) + bytes(residual) + bytes(direction) +
+           bytes(potential);
+  total += bytes(cg.residual) + bytes(cg.preconditioned) +
+           bytes(cg.direction) + bytes(cg.image);
+  return total;
+}
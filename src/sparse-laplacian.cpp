@@ -0,0 +1,14 @@
+#include "sparse-laplacian.hpp"
+
+void SparseLaplacian::multiply(const std::vector<double> &x,
+                               std::vector<double> &y) const {
+  const int n = size();
+  y.resize(n);
+  for (int i = 0; i < n; i++) {
+    double sum = diagonal[i] * x[i];
+    for (int k = offsets[i]; k < offsets[i + 1]; k++) {
+      sum += values[k] * x[columns[k]];
+    }
+    y[i] = sum;
+  }
+}
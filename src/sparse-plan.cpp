@@ -0,0 +1,46 @@
+#include "sparse-plan.hpp"
+#include <algorithm>
+
+void SparsePlan::assign(std::vector<std::pair<int, double>> &entries) {
+  std::sort(entries.begin(), entries.end());
+  clear();
+  for (const auto &[j, mass] : entries) {
+    push_back(j, mass);
+  }
+}
+
+double SparsePlan::operator[](int j) const {
+  auto cit = std::lower_bound(columns.begin(), columns.end(), j);
+  if (cit == columns.end() || *cit != j) {
+    return 0;
+  }
+  return masses[cit - columns.begin()];
+}
+
+void SparsePlan::add(int j, double mass) {
+  auto cit = std::lower_bound(columns.begin(), columns.end(), j);
+  if (cit != columns.end() && *cit == j) {
+    masses[cit - columns.begin()] += mass;
+  }
+}
+
+SparsePlan SparsePlan::combination(double s, const SparsePlan &a, double t,
+                                   const SparsePlan &b) {
+  SparsePlan c;
+  int k = 0;
+  int l = 0;
+  while (k < a.size() || l < b.size()) {
+    if (l == b.size() || (k < a.size() && a.columns[k] < b.columns[l])) {
+      c.push_back(a.columns[k], s * a.masses[k]);
+      k++;
+    } else if (k == a.size() || b.columns[l] < a.columns[k]) {
+      c.push_back(b.columns[l], t * b.masses[l]);
+      l++;
+    } else {
+      c.push_back(a.columns[k], s * a.masses[k] + t * b.masses[l]);
+      k++;
+      l++;
+    }
+  }
+  return c;
+}
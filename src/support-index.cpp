@@ -0,0 +1,375 @@
+#include "power-diagram.hpp"
+#include <algorithm>
+#include <cmath>
+#include <tuple>
+
+namespace {
+double side(const clip_vertex &a, const clip_vertex &b, const clip_vertex &p) {
+  return (b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x);
+}
+
+/* Exact predicate of the kernel, so that the tests of crossings and of
+ * inclusion agree near degenerate configurations */
+int orientation(const clip_vertex &a, const clip_vertex &b,
+                const clip_vertex &p) {
+  return CGAL::orientation(K::Point_2(a.x, a.y), K::Point_2(b.x, b.y),
+                           K::Point_2(p.x, p.y));
+}
+
+/* Whether p is on the left of the line through a and b, once the convex
+ * polygon is moved by (epsilon, epsilon^2): the line when moving_line, the
+ * point otherwise. No point is then ever on a line. */
+bool is_left(const clip_vertex &p, const clip_vertex &a, const clip_vertex &b,
+             bool moving_line) {
+  const int o = orientation(a, b, p);
+  if (o != 0) {
+    return o > 0;
+  }
+  const double e_x = moving_line ? a.x - b.x : b.x - a.x;
+  const double e_y = moving_line ? a.y - b.y : b.y - a.y;
+  return e_y != 0 ? e_y < 0 : e_x > 0;
+}
+
+/* Crossings sorted along an edge alternately enter and leave a region.
+ * Restore this order where rounding swapped nearly coincident crossings. */
+template <class It, class Enters>
+void alternate(It first, It last, bool inside, Enters enters) {
+  for (It it = first; it != last; ++it) {
+    if (enters(*it) == inside) {
+      It match = std::find_if(std::next(it), last, [&](const auto &c) {
+        return enters(c) != inside;
+      });
+      if (match != last) {
+        std::rotate(it, match, std::next(match));
+      }
+    }
+    inside = not inside;
+  }
+}
+} // namespace
+
+int SupportIndex::column(double x) const {
+  return std::clamp<int>((x - x_min) / width, 0, n_x - 1);
+}
+
+int SupportIndex::row(double y) const {
+  return std::clamp<int>((y - y_min) / height, 0, n_y - 1);
+}
+
+void SupportIndex::build(const std::vector<clip_vertex> &polygon) {
+  support = polygon;
+  const int m = support.size();
+  cell_offsets.clear();
+  cell_edges.clear();
+  if (m < 3) {
+    support.clear();
+    return;
+  }
+  x_min = x_max = support[0].x;
+  y_min = y_max = support[0].y;
+  for (const auto &v : support) {
+    x_min = std::min(x_min, v.x);
+    x_max = std::max(x_max, v.x);
+    y_min = std::min(y_min, v.y);
+    y_max = std::max(y_max, v.y);
+  }
+  n_x = n_y = std::max<int>(1, std::ceil(std::sqrt(double(m))));
+  width = x_max > x_min ? (x_max - x_min) / n_x : 1;
+  height = y_max > y_min ? (y_max - y_min) / n_y : 1;
+
+  /* Each edge goes to the grid cells overlapped by its bounding box */
+  auto for_each_cell = [this](int e, auto &&f) {
+    const clip_vertex &a = support[e];
+    const clip_vertex &b = support[e + 1 < support.size() ? e + 1 : 0];
+    for (int c_y = row(std::min(a.y, b.y)); c_y <= row(std::max(a.y, b.y));
+         c_y++) {
+      for (int c_x = column(std::min(a.x, b.x));
+           c_x <= column(std::max(a.x, b.x)); c_x++) {
+        f(c_y * n_x + c_x);
+      }
+    }
+  };
+  cell_offsets.assign(n_x * n_y + 1, 0);
+  for (int e = 0; e < m; e++) {
+    for_each_cell(e, [this](int c) { cell_offsets[c + 1]++; });
+  }
+  for (int c = 0; c < n_x * n_y; c++) {
+    cell_offsets[c + 1] += cell_offsets[c];
+  }
+  cell_edges.resize(cell_offsets.back());
+  std::vector<int> next(cell_offsets.begin(), cell_offsets.end() - 1);
+  for (int e = 0; e < m; e++) {
+    for_each_cell(e, [&](int c) { cell_edges[next[c]++] = e; });
+  }
+}
+
+std::vector<clip_vertex> SupportIndex::box(double margin) const {
+  const double d = margin * std::max(x_max - x_min, y_max - y_min);
+  return {{x_min - d, y_min - d, -1},
+          {x_max + d, y_min - d, -1},
+          {x_max + d, y_max + d, -1},
+          {x_min - d, y_max + d, -1}};
+}
+
+bool SupportIndex::contains(double x, double y) const {
+  if (support.empty() || x < x_min || x > x_max || y < y_min || y > y_max) {
+    return false;
+  }
+  /* Cast a ray to the right along a single row of the grid. A crossing is
+   * counted in the grid cell containing it only, since edges may overlap
+   * several grid cells. The point is moved as in is_left(). */
+  bool inside = false;
+  const int c_y = row(y);
+  const int m = support.size();
+  /* Start one grid cell early, for crossings rounded to the left of it */
+  for (int c_x = std::max(column(x) - 1, 0); c_x < n_x; c_x++) {
+    const int c = c_y * n_x + c_x;
+    for (int k = cell_offsets[c]; k < cell_offsets[c + 1]; k++) {
+      const clip_vertex &a = support[cell_edges[k]];
+      const clip_vertex &b = support[cell_edges[k] + 1 < m ? cell_edges[k] + 1 : 0];
+      if ((a.y > y) != (b.y > y)) {
+        const double x_cross = a.x + (y - a.y) / (b.y - a.y) * (b.x - a.x);
+        if (column(x_cross) == c_x &&
+            is_left({x, y, -1}, a, b, false) == (b.y > a.y)) {
+          inside = not inside;
+        }
+      }
+    }
+  }
+  return inside;
+}
+
+/* The boundary of the intersection is made of the pieces of support edges
+ * inside the convex polygon and of the pieces of its edges inside the
+ * support. Pieces are cut at the crossings of both boundaries, and chained
+ * into rings through the keys of their ends: support vertices, then convex
+ * polygon vertices, then crossings. Keys do not depend on rounding, so that
+ * the rings close whatever the number of crossings. */
+void SupportIndex::intersect(const std::vector<clip_vertex> &convex,
+                             cut_buffer &buffer) const {
+  auto &edges = buffer.edges;
+  auto &crossings = buffer.crossings;
+  auto &first_crossing = buffer.first_crossing;
+  auto &pieces = buffer.pieces;
+  buffer.vertices.clear();
+  buffer.ring_offsets.assign(1, 0);
+  crossings.clear();
+  first_crossing.clear();
+  pieces.clear();
+  edges.clear();
+
+  const int m = support.size();
+  const int k = convex.size();
+  if (m == 0 || k < 3) {
+    return;
+  }
+  double b_x_min = convex[0].x, b_x_max = convex[0].x;
+  double b_y_min = convex[0].y, b_y_max = convex[0].y;
+  for (const auto &v : convex) {
+    b_x_min = std::min(b_x_min, v.x);
+    b_x_max = std::max(b_x_max, v.x);
+    b_y_min = std::min(b_y_min, v.y);
+    b_y_max = std::max(b_y_max, v.y);
+  }
+  if (b_x_max < x_min || b_x_min > x_max || b_y_max < y_min ||
+      b_y_min > y_max) {
+    return;
+  }
+
+  /* Support edges near the convex polygon */
+  for (int c_y = row(b_y_min); c_y <= row(b_y_max); c_y++) {
+    for (int c_x = column(b_x_min); c_x <= column(b_x_max); c_x++) {
+      const int c = c_y * n_x + c_x;
+      edges.insert(edges.end(), cell_edges.begin() + cell_offsets[c],
+                   cell_edges.begin() + cell_offsets[c + 1]);
+    }
+  }
+  std::sort(edges.begin(), edges.end());
+  edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+  /* Crossings of both boundaries, grouped by support edge. Degenerate
+   * configurations are resolved by moving the convex polygon by an
+   * infinitesimal (epsilon, epsilon^2), see is_left(). */
+  auto next_support = [m](int e) { return e + 1 < m ? e + 1 : 0; };
+  auto next_convex = [k](int p) { return p + 1 < k ? p + 1 : 0; };
+  for (int e : edges) {
+    const clip_vertex &a = support[e];
+    const clip_vertex &b = support[next_support(e)];
+    first_crossing.push_back(crossings.size());
+    for (int p = 0; p < k; p++) {
+      const clip_vertex &q = convex[p];
+      const clip_vertex &r = convex[next_convex(p)];
+      const bool a_is_left = is_left(a, q, r, true);
+      const bool r_is_left = is_left(r, a, b, false);
+      if (a_is_left == is_left(b, q, r, true) ||
+          is_left(q, a, b, false) == r_is_left) {
+        continue;
+      }
+      const double d_a = side(q, r, a);
+      const double d_b = side(q, r, b);
+      const double d_q = side(a, b, q);
+      const double d_r = side(a, b, r);
+      const double t = d_a / (d_a - d_b);
+      crossings.push_back({e, p, t, d_q / (d_q - d_r), a.x + t * (b.x - a.x),
+                           a.y + t * (b.y - a.y), not a_is_left,
+                           r_is_left});
+    }
+  }
+  first_crossing.push_back(crossings.size());
+  const int convex_key = m;
+  const int crossing_key = m + k;
+
+  /* Pieces of support edges inside the convex polygon */
+  for (int n = 0; n < edges.size(); n++) {
+    const int e = edges[n];
+    const clip_vertex &a = support[e];
+    bool inside = true;
+    for (int p = 0; p < k && inside; p++) {
+      inside = is_left(a, convex[p], convex[next_convex(p)], true);
+    }
+    auto first = crossings.begin() + first_crossing[n];
+    auto last = crossings.begin() + first_crossing[n + 1];
+    std::sort(first, last, [](const crossing &c1, const crossing &c2) {
+      return c1.t < c2.t;
+    });
+    alternate(first, last, inside,
+              [](const crossing &c) { return c.enters_convex; });
+    piece current{e, -1, a.x, a.y, -1};
+    for (int c = first_crossing[n]; c < first_crossing[n + 1]; c++) {
+      if (inside) {
+        current.to = crossing_key + c;
+        pieces.push_back(current);
+      }
+      current = {crossing_key + c, -1, crossings[c].x, crossings[c].y, -1};
+      inside = not inside;
+    }
+    if (inside) {
+      current.to = next_support(e);
+      pieces.push_back(current);
+    }
+  }
+
+  /* Pieces of the convex polygon edges inside the support */
+  auto &order = buffer.order;
+  order.resize(crossings.size());
+  for (int c = 0; c < crossings.size(); c++) {
+    order[c] = c;
+  }
+  std::sort(order.begin(), order.end(), [&crossings](int c1, int c2) {
+    return std::tie(crossings[c1].side, crossings[c1].s) <
+           std::tie(crossings[c2].side, crossings[c2].s);
+  });
+  bool inside = contains(convex[0].x, convex[0].y);
+  auto c = order.begin();
+  for (int p = 0; p < k; p++) {
+    const int label = convex[p].label;
+    auto last = std::find_if(c, order.end(), [&crossings, p](int d) {
+      return crossings[d].side != p;
+    });
+    alternate(c, last, inside,
+              [&crossings](int d) { return crossings[d].enters_support; });
+    piece current{convex_key + p, -1, convex[p].x, convex[p].y, label};
+    for (; c != order.end() && crossings[*c].side == p; ++c) {
+      if (inside) {
+        current.to = crossing_key + *c;
+        pieces.push_back(current);
+      }
+      current = {crossing_key + *c, -1, crossings[*c].x, crossings[*c].y,
+                 label};
+      inside = not inside;
+    }
+    if (inside) {
+      current.to = convex_key + next_convex(p);
+      pieces.push_back(current);
+    }
+  }
+
+  /* Chain the pieces into rings, dropping any ring left open by a
+   * degenerate crossing. */
+  std::sort(pieces.begin(), pieces.end(),
+            [](const piece &p1, const piece &p2) { return p1.from < p2.from; });
+  auto &used = buffer.used;
+  used.assign(pieces.size(), false);
+  for (int start = 0; start < pieces.size(); start++) {
+    if (used[start]) {
+      continue;
+    }
+    const int ring_first = buffer.vertices.size();
+    int current = start;
+    bool closed = false;
+    for (int steps = 0; steps < pieces.size(); steps++) {
+      const piece &p = pieces[current];
+      used[current] = true;
+      buffer.vertices.push_back({p.x, p.y, p.label});
+      auto it = std::lower_bound(
+          pieces.begin(), pieces.end(), p.to,
+          [](const piece &q, int key) { return q.from < key; });
+      if (it == pieces.end() || it->from != p.to) {
+        break;
+      }
+      current = it - pieces.begin();
+      if (current == start) {
+        closed = true;
+        break;
+      }
+      if (used[current]) {
+        break;
+      }
+    }
+    if (closed && buffer.vertices.size() - ring_first > 2) {
+      buffer.ring_offsets.push_back(buffer.vertices.size());
+    } else {
+      buffer.vertices.resize(ring_first);
+    }
+  }
+}
+
+/* For a non-convex support, the power cell is first clipped to the
+ * bounding box of the support, then intersected with the support edges
+ * found around it. A cell cut into several rings is stored as one chain,
+ * joining each ring to the first one by a cut of zero width, so that its
+ * moments are still given by the shoelace sums. */
+void PowerDiagram::cut_cell(Vertex_handle vh, crop_buffer &buffer) {
+  const int index = vh->info();
+  const int first = buffer.vertices.size();
+  auto &clipper = buffer.clipper;
+  clipper.reset(support_box);
+  clip_by_neighbours(vh, clipper);
+  if (clipper.is_empty()) {
+    close_cell(buffer, index, first);
+    return;
+  }
+
+  auto &cut = buffer.cut;
+  support_index.intersect(clipper.vertices(), cut);
+  buffer.n_tests += cut.edges.size();
+  const int n_rings = cut.ring_offsets.size() - 1;
+  for (int r = 0; r < n_rings; r++) {
+    if (r > 0) {
+      const K::Point_2 start = buffer.vertices[first];
+      buffer.vertices.push_back(start);
+    }
+    const int ring_first = buffer.vertices.size();
+    const int begin = cut.ring_offsets[r];
+    const int end = cut.ring_offsets[r + 1];
+    for (int k = begin; k < end; k++) {
+      const clip_vertex &v = cut.vertices[k];
+      const clip_vertex &next = cut.vertices[k + 1 < end ? k + 1 : begin];
+      const K::Point_2 p(v.x, v.y);
+      const K::Point_2 q(next.x, next.y);
+      if (buffer.vertices.size() == ring_first ||
+          buffer.vertices.back() != p) {
+        buffer.vertices.push_back(p);
+      }
+      if (v.label >= 0 && p != q) {
+        buffer.borders.push_back({index, v.label, {p, q}});
+      }
+    }
+    if (r > 0) {
+      const K::Point_2 start = buffer.vertices[ring_first];
+      buffer.vertices.push_back(start);
+    }
+  }
+
+  close_cell(buffer, index, first);
+}
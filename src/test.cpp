@@ -8,17 +8,96 @@ double test_area_and_border() {
   pd.gnuplot();
   auto data_area = pd.area();
   double check_area = 0;
-  for (auto cit = data_area.begin(); cit != data_area.end(); ++cit) {
-    check_area += cit->second;
+  for (double a : data_area) {
+    check_area += a;
   }
-  std::cout << "This diagram has " << pd.borders.size() << " valid borders."
-            << std::endl;
-  for (auto p : pd.borders) {
-    std::cerr << p.first << "\t--+--\t" << p.second << std::endl;
+  std::cout << "This diagram has " << pd.number_of_borders()
+            << " valid borders." << std::endl;
+  for (int i = 0; i < pd.number_of_sites(); i++) {
+    for (int k = pd.neighbour_offsets[i]; k < pd.neighbour_offsets[i + 1];
+         k++) {
+      const int j = pd.neighbours[k];
+      if (i < j) {
+        std::cerr << K::Segment_2(pd.site(i).point(), pd.site(j).point())
+                  << "\t--+--\t" << pd.borders[k] << std::endl;
+      }
+    }
   }
   return check_area;
 }
 
+static void constant_density(const double *points, size_t n, double *values,
+                             void *params) {
+  std::fill(values, values + n, 1.0);
+}
+
+/* For a non-convex support, the cell masses of a constant density, by
+ * quadrature and on a raster, should be the shoelace areas of the cells */
+double test_non_convex_masses() {
+  PowerDiagram::polygon support;
+  support.push_back(K::Point_2(0, 0));
+  support.push_back(K::Point_2(1, 0));
+  support.push_back(K::Point_2(1, 0.4));
+  support.push_back(K::Point_2(0.35, 0.45));
+  support.push_back(K::Point_2(0.4, 1));
+  support.push_back(K::Point_2(0, 1));
+  std::srand(1);
+  std::vector<PowerDiagram::vertex> sites;
+  for (int i = 0; i < 200; i++) {
+    sites.push_back(PowerDiagram::vertex(
+        K::Point_2(std::rand() / (1.0 + RAND_MAX),
+                   std::rand() / (1.0 + RAND_MAX)),
+        0));
+  }
+  PowerDiagram pd(sites.begin(), sites.end());
+  pd.crop(support);
+  const auto area = pd.area();
+  CellQuadrature quadrature(constant_density, nullptr);
+  const auto by_quadrature = pd.integral(quadrature);
+  /* A unit density on the unit square */
+  RasterDensity raster(0, 0, 1, 1, 16, 16, std::vector<double>(256, 1));
+  const auto by_raster = pd.integral(raster);
+  double error = 0;
+  for (int i = 0; i < area.size(); i++) {
+    error = std::max(error, std::abs(by_quadrature[i] - area[i]));
+    error = std::max(error, std::abs(by_raster[i] - area[i]));
+  }
+  return error;
+}
+
+/* A raster normalized on a non-convex support should give the cells a
+ * total mass of one, that of the plans */
+double test_raster_total_mass() {
+  const double support[] = {0, 0, 1, 0, 1, 0.4, 0.35, 0.45, 0.4, 1, 0, 1};
+  PowerDiagram::polygon polygon;
+  for (int k = 0; k < 6; k++) {
+    polygon.push_back(K::Point_2(support[2 * k], support[2 * k + 1]));
+  }
+  std::srand(2);
+  std::vector<PowerDiagram::vertex> sites;
+  for (int i = 0; i < 200; i++) {
+    sites.push_back(PowerDiagram::vertex(
+        K::Point_2(std::rand() / (1.0 + RAND_MAX),
+                   std::rand() / (1.0 + RAND_MAX)),
+        0));
+  }
+  PowerDiagram pd(sites.begin(), sites.end());
+  pd.crop(polygon);
+  std::vector<double> pixels(16 * 16);
+  for (int j = 0; j < 16; j++) {
+    for (int i = 0; i < 16; i++) {
+      pixels[j * 16 + i] = 1 + i + 2 * j;
+    }
+  }
+  RasterDensity raster(0, 0, 1, 1, 16, 16, pixels);
+  raster.normalize(support, 6);
+  double total = 0;
+  for (double mass : pd.integral(raster)) {
+    total += mass;
+  }
+  return std::abs(total - 1);
+}
+
 double find_barycenter(int argc, char *argv[]) {
   auto default_problem = WassersteinBarycenter(
       K::Iso_rectangle_2{0, 0, 1, 1}, "data/marginals",
@@ -35,6 +114,19 @@ int main(int argc, char *argv[]) {
   /* std::cout << "Area test for cell crop algorithm get: " << area <<
    * std::endl; */
 
+  const double mass_error = test_non_convex_masses();
+  std::cout << "Cell masses of a constant density on a non-convex support "
+               "differ from their areas by at most "
+            << mass_error << "." << std::endl;
+  const double total_error = test_raster_total_mass();
+  std::cout << "Cell masses of a raster on a non-convex support add up to "
+               "one up to "
+            << total_error << "." << std::endl;
+  if (not(mass_error < 1e-9 && total_error < 1e-9)) {
+    std::cerr << "Cell masses on a non-convex support are wrong." << std::endl;
+    return EXIT_FAILURE;
+  }
+
   double error = find_barycenter(argc, argv);
   std::cout << "Wasserstein barycenter searching gets result with error: "
             << error << std::endl;
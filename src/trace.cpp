@@ -0,0 +1,61 @@
+#include "trace.hpp"
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+static const char *phase_names[n_trace_phases] = {
+    "triangulation", "crop",         "area",   "integration",
+    "jacobian",      "linear_solve", "simplex"};
+static const char *counter_names[n_trace_counters] = {
+    "rebuilds",          "incremental_updates", "intersection_tests",
+    "newton_iterations", "cache_hits",          "cache_misses"};
+
+Trace::Trace() : start(std::chrono::steady_clock::now()) {
+  if (const char *filename = std::getenv("BARYCENTER_TRACE")) {
+    file.open(filename);
+    enabled = file.is_open();
+    if (not enabled) {
+      std::cerr << "Cannot open trace file " << filename << "." << std::endl;
+    }
+  }
+}
+
+Trace &Trace::global() {
+  static Trace trace;
+  return trace;
+}
+
+void Trace::write(
+    trace_level level, const char *event,
+    std::initializer_list<std::pair<const char *, double>> fields) {
+  if (not enabled) {
+    return;
+  }
+  const double t =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+          .count();
+  file << "{\"event\": \"" << event << "\", \"level\": \""
+       << (level == Inner ? "inner" : "outer") << "\", \"t\": " << t;
+  for (const auto &field : fields) {
+    file << ", \"" << field.first << "\": ";
+    if (std::isfinite(field.second)) {
+      file << field.second;
+    } else {
+      file << "null";
+    }
+  }
+  file << ", \"seconds\": {";
+  for (int p = 0; p < n_trace_phases; p++) {
+    file << (p ? ", \"" : "\"") << phase_names[p]
+         << "\": " << seconds[level][p];
+    seconds[level][p] = 0;
+  }
+  file << "}, \"counts\": {";
+  for (int c = 0; c < n_trace_counters; c++) {
+    file << (c ? ", \"" : "\"") << counter_names[c]
+         << "\": " << counts[level][c];
+    counts[level][c] = 0;
+  }
+  file << "}}\n";
+  file.flush();
+}
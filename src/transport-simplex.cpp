@@ -0,0 +1,208 @@
+#include "transport-simplex.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+void TransportSimplex::reset(const std::vector<double> &supply,
+                             const std::vector<double> &demand) {
+  m = supply.size();
+  n = demand.size();
+  basis.clear();
+  next_cell = 0;
+  if (m == 0 || n == 0) {
+    return;
+  }
+  /* A zero step still adds a degenerate arc, so that the basis always has
+   * m + n - 1 arcs. Ties move to the next column, so that a degenerate arc
+   * hangs a column below its row: the tree rooted at row 0 is then strongly
+   * feasible, as long as no row has a zero supply. */
+  std::vector<double> a = supply;
+  std::vector<double> b = demand;
+  int i = 0;
+  int j = 0;
+  while (true) {
+    const double t = std::max(std::min(a[i], b[j]), 0.0);
+    basis.push_back({i, j, t});
+    a[i] -= t;
+    b[j] -= t;
+    if (i == m - 1 && j == n - 1) {
+      break;
+    }
+    if (j == n - 1 || (i < m - 1 && a[i] < b[j])) {
+      i++;
+    } else {
+      j++;
+    }
+  }
+}
+
+/* Parents, depths and potentials u_i + v_j = cost of every basic arc, with
+ * u_0 = 0 */
+void TransportSimplex::build_tree(const std::vector<double> &cost) {
+  const int n_nodes = m + n;
+  incident.resize(n_nodes);
+  for (auto &arcs : incident) {
+    arcs.clear();
+  }
+  for (int k = 0; k < basis.size(); k++) {
+    incident[basis[k].row].push_back(k);
+    incident[m + basis[k].column].push_back(k);
+  }
+  parent.assign(n_nodes, -1);
+  parent_arc.assign(n_nodes, -1);
+  depth.assign(n_nodes, 0);
+  node_potential.assign(n_nodes, 0);
+  hang(0, -1, -1, cost);
+}
+
+/* Hang the node top below the node above through the basic arc, or make it
+ * the root if above is -1, and update the parents, depths and potentials of
+ * the nodes it reaches without going back through that arc. */
+void TransportSimplex::hang(int top, int above, int arc,
+                            const std::vector<double> &cost) {
+  parent[top] = above;
+  parent_arc[top] = arc;
+  depth[top] = above < 0 ? 0 : depth[above] + 1;
+  node_potential[top] =
+      above < 0 ? 0
+                : cost[basis[arc].row * n + basis[arc].column] -
+                      node_potential[above];
+  queue.assign(1, top);
+  for (int q = 0; q < queue.size(); q++) {
+    const int node = queue[q];
+    for (int k : incident[node]) {
+      const int other = node < m ? m + basis[k].column : basis[k].row;
+      if (k == parent_arc[node]) {
+        continue;
+      }
+      parent[other] = node;
+      parent_arc[other] = k;
+      depth[other] = depth[node] + 1;
+      node_potential[other] =
+          cost[basis[k].row * n + basis[k].column] - node_potential[node];
+      queue.push_back(other);
+    }
+  }
+}
+
+/* Let the arc (i, j) enter the basis. The cycle it closes is traversed from
+ * the apex, the common ancestor of row i and column j, down to row i, along
+ * the arc (i, j) and up from column j. The arcs traversed from a column to a
+ * row lose the flow, and the last one of smallest flow leaves, which is the
+ * rule of Cunningham: the basis stays strongly feasible, so that degenerate
+ * pivots cannot cycle. Only the subtree cut off by the leaving arc is then
+ * hung again, below the arc (i, j). */
+bool TransportSimplex::pivot(int i, int j, const std::vector<double> &cost) {
+  /* Nodes whose parent arcs make the paths from row i and from column j up
+   * to the apex */
+  std::vector<int> &row_path = cycle;
+  std::vector<int> &column_path = branch;
+  row_path.clear();
+  column_path.clear();
+  int a = i;
+  int b = m + j;
+  while (a != b) {
+    if (depth[a] >= depth[b]) {
+      row_path.push_back(a);
+      a = parent[a];
+    } else {
+      column_path.push_back(b);
+      b = parent[b];
+    }
+  }
+  if (row_path.empty() && column_path.empty()) {
+    return false;
+  }
+  /* Down to row i, an arc loses the flow if its lower node is a row, and up
+   * from column j, if its lower node is a column. */
+  int leaving = -1;
+  bool below_row = false;
+  double theta = std::numeric_limits<double>::max();
+  for (auto it = row_path.rbegin(); it != row_path.rend(); ++it) {
+    if (*it < m && basis[parent_arc[*it]].flow <= theta) {
+      leaving = *it;
+      below_row = true;
+      theta = basis[parent_arc[*it]].flow;
+    }
+  }
+  for (int node : column_path) {
+    if (node >= m && basis[parent_arc[node]].flow <= theta) {
+      leaving = node;
+      below_row = false;
+      theta = basis[parent_arc[node]].flow;
+    }
+  }
+  if (leaving < 0) {
+    return false;
+  }
+  for (int node : row_path) {
+    basis[parent_arc[node]].flow += node < m ? -theta : theta;
+  }
+  for (int node : column_path) {
+    basis[parent_arc[node]].flow += node >= m ? -theta : theta;
+  }
+
+  /* The arc (i, j) takes the place of the leaving arc in the basis */
+  const int k = parent_arc[leaving];
+  for (int node : {leaving, parent[leaving]}) {
+    auto &arcs = incident[node];
+    arcs.erase(std::find(arcs.begin(), arcs.end(), k));
+  }
+  basis[k] = {i, j, theta};
+  incident[i].push_back(k);
+  incident[m + j].push_back(k);
+  if (below_row) {
+    hang(i, m + j, k, cost);
+  } else {
+    hang(m + j, i, k, cost);
+  }
+  return true;
+}
+
+int TransportSimplex::solve(const std::vector<double> &cost,
+                            double tolerance) {
+  if (not is_initialized()) {
+    return 0;
+  }
+  const long n_cells = long(m) * n;
+  /* Blocks of about the square root of the number of cells are scanned for
+   * the most negative reduced cost, which is much cheaper than a full scan
+   * per pivot for as many pivots. */
+  const long block = std::max<long>(std::sqrt(double(n_cells)), 1);
+  const int max_pivots = 100 * (m + n) + 1000;
+  int pivots = 0;
+  build_tree(cost);
+  while (pivots < max_pivots) {
+    int entering_i = -1;
+    int entering_j = -1;
+    double most_negative = -tolerance;
+    long scanned = 0;
+    while (scanned < n_cells) {
+      const long end = std::min(scanned + block, n_cells);
+      for (; scanned < end; scanned++) {
+        const long cell = (next_cell + scanned) % n_cells;
+        const int i = cell / n;
+        const int j = cell % n;
+        const double reduced =
+            cost[cell] - node_potential[i] - node_potential[m + j];
+        if (reduced < most_negative) {
+          most_negative = reduced;
+          entering_i = i;
+          entering_j = j;
+        }
+      }
+      if (entering_i >= 0) {
+        break;
+      }
+    }
+    if (entering_i < 0) {
+      return pivots;
+    }
+    next_cell = (next_cell + scanned) % n_cells;
+    if (not pivot(entering_i, entering_j, cost)) {
+      return pivots;
+    }
+    pivots++;
+  }
+  return -1;
+}
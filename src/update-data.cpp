@@ -6,8 +6,8 @@ void WassersteinBarycenter::update_partition_and_gradient() {
     std::exit(EXIT_SUCCESS);
   }
 
-  if (discrete_plan.size() != n_column_variables + 1) {
-    std::cout << "Discrete plan has wrong size when updating partition."
+  if (discrete_plan.empty()) {
+    std::cout << "Discrete plan is empty when updating partition."
               << std::endl;
     std::exit(EXIT_SUCCESS);
   }
@@ -34,11 +34,27 @@ void WassersteinBarycenter::update_partition_and_gradient() {
   double partition_area_sum = 0;
 
   for (int j : valid_column_variables) {
-    partition_vertices.push_back(PowerDiagram::vertex{support_points[j], potential[j]});
+    partition_vertices.push_back(PowerDiagram::vertex{support_point(j), potential[j]});
+  }
+
+  /* Reuse the current regular triangulation if it has the same sites */
+  int n_cropped_cells = -1;
+  if (incremental_partition) {
+    n_cropped_cells = partition.update_weights(partition_vertices);
+  }
+  if (n_cropped_cells < 0) {
+    partition.assign(partition_vertices.begin(), partition_vertices.end());
+    initialize_support();
   }
-  partition = PowerDiagram(partition_vertices.begin(), partition_vertices.end());
-  initialize_support();
   auto cell_areas = partition.area();
+  auto cell_masses = cell_areas;
+  if (support_measure == Density) {
+    cell_masses = partition.integral(quadrature);
+    border_masses = partition.border_integral(quadrature);
+  } else if (support_measure == Raster) {
+    cell_masses = partition.integral(raster);
+    border_masses = partition.border_integral(raster);
+  }
   {
     int n = partition.number_of_hidden_vertices();
     if (n > 0) {
@@ -49,11 +65,9 @@ void WassersteinBarycenter::update_partition_and_gradient() {
 
   int i = 0;
   for (int j : valid_column_variables) {
-    auto v = partition_vertices[i];
+    gradient[j] = discrete_plan[j] - cell_masses[i];
+    partition_area_sum += cell_areas[i];
     i++;
-    double a = cell_areas[v];
-    gradient[j] = discrete_plan[j] - a;
-    partition_area_sum += a;
   }
 
   if (std::abs(partition_area_sum - support_area) > 10e-6) {
@@ -79,8 +93,42 @@ void WassersteinBarycenter::update_partition_and_gradient() {
   }
 }
 
+double WassersteinBarycenter::transport_cost() const {
+  double cost = 0;
+  const int n =
+      std::min<int>(valid_column_variables.size(), partition.moments.size());
+  for (int i = 0; i < n; i++) {
+    cost += partition.moments[i].squared_distance(
+        support_point(valid_column_variables[i]));
+  }
+  return cost / support_area;
+}
+
+/* Only basic columns have a nonzero value, the others being at their lower
+ * bound, so the plan is read from the basis header in as many steps as rows.
+ * Every column is read if there is no factorization of the basis. */
+template <class ColumnVariable>
+void WassersteinBarycenter::read_basic_plan(ColumnVariable column_variable) {
+  std::vector<std::pair<int, double>> entries;
+  const int n_rows = glp_get_num_rows(lp);
+  if (glp_bf_exists(lp)) {
+    for (int b = 1; b <= n_rows; b++) {
+      const int k = glp_get_bhead(lp, b) - n_rows;
+      if (k > 0) {
+        entries.push_back({column_variable(k), glp_get_col_prim(lp, k)});
+      }
+    }
+  } else {
+    const int n_columns = glp_get_num_cols(lp);
+    for (int k = 1; k <= n_columns; k++) {
+      entries.push_back({column_variable(k), glp_get_col_prim(lp, k)});
+    }
+  }
+  discrete_plan.assign(entries);
+}
+
 void WassersteinBarycenter::update_discrete_plan() {
-  if (discrete_plan.size() != n_column_variables + 1) {
+  if (discrete_plan.empty()) {
     if (lp_solve_called) {
       std::cout << "No dicrete plan data found.";
       std::exit(EXIT_FAILURE);
@@ -95,50 +143,80 @@ void WassersteinBarycenter::update_discrete_plan() {
     std::exit(EXIT_FAILURE);
   }
 
-  for (int j = 1; j <= n_column_variables; j++) {
-    glp_set_obj_coef(
-        lp, j, potential[j] * marginal_coefficients.front() - squared_norm[j]);
+  if (use_network_simplex && n_marginals == 2) {
+    if (update_transport_plan()) {
+      return;
+    }
+    std::cout << "Network simplex stopped at its pivot limit, solve the LP "
+                 "by the simplex of GLPK."
+              << std::endl;
   }
 
-  glp_simplex(lp, NULL);
-  discrete_plan = {0};
+  if (use_column_generation) {
+    for (int k = 1; k < lp_columns.size(); k++) {
+      glp_set_obj_coef(lp, k, lp_cost(lp_columns[k]));
+    }
+    {
+      scoped_timer timer(Simplex);
+      do {
+        glp_simplex(lp, NULL);
+      } while (price_lp_columns() > 0);
+    }
+    read_basic_plan([this](int k) { return lp_columns[k]; });
+    return;
+  }
 
-  for (int j = 1; j <= n_column_variables; j++) {
-    discrete_plan.push_back(glp_get_col_prim(lp, j));
+  {
+    std::vector<double> cost(n_column_variables + 1);
+    lp_costs(1, n_column_variables, cost.data() + 1);
+    for (int j = 1; j <= n_column_variables; j++) {
+      glp_set_obj_coef(lp, j, cost[j]);
+    }
   }
+
+  {
+    scoped_timer timer(Simplex);
+    glp_simplex(lp, NULL);
+  }
+  read_basic_plan([](int k) { return k; });
 }
 
 void WassersteinBarycenter::update_column_variables() {
-  dumb_column_variables.clear();
-  valid_column_variables.clear();
-  for (int j = 1; j <= n_column_variables; j++) {
-    if (discrete_plan[j] != 0) {
-      valid_column_variables.push_back(j);
-    } else {
-      dumb_column_variables.insert(j);
-    }
-  }
+  valid_column_variables = discrete_plan.support();
 }
 
 void WassersteinBarycenter::extend_concave_potential() {
   update_partition_and_gradient();
   int n_vertices = valid_column_variables.size();
-  for (auto k : dumb_column_variables) {
+  /* Every other column variable, by a merge with the sorted valid ones */
+  std::vector<int> valid = valid_column_variables;
+  std::sort(valid.begin(), valid.end());
+  valid.push_back(n_column_variables + 1);
+  auto vit = valid.begin();
+  for (int k = 1; k <= n_column_variables; k++) {
+    if (k == *vit) {
+      ++vit;
+      continue;
+    }
+    const K::Point_2 point_k = support_point(k);
     double u_star = -10e5;
     for (int i = 0; i < n_vertices; i++) {
       const int j = valid_column_variables[i];
-      const auto cell = partition.cropped_cells[partition_vertices[i]];
-      const double u_star_defined = 0.5 * (squared_norm[j] - potential[j]);
-      for (auto p : cell.vertices()) {
+      /* The points of the valid column variables are those of the sites */
+      const K::Point_2 &point_j = partition_vertices[i].point();
+      const double u_star_defined = 0.5 * (squared_norm(j) - potential[j]);
+      for (int l = partition.cell_offsets[i]; l < partition.cell_offsets[i + 1];
+           l++) {
+        const auto &p = partition.cell_vertices[l];
         double comp = K::Vector_2(K::Point_2(0, 0), p) *
-                          K::Vector_2(support_points[j], support_points[k]) +
+                          K::Vector_2(point_j, point_k) +
                       u_star_defined;
         if (comp > u_star) {
           u_star = comp;
         }
       }
     }
-    potential[k] = squared_norm[k] - 2 * u_star;
+    potential[k] = squared_norm(k) - 2 * u_star;
   }
 
   double average = 0;
@@ -154,7 +232,6 @@ void WassersteinBarycenter::extend_concave_potential() {
 
 void WassersteinBarycenter::reset_valid_colunm_variables() {
   valid_column_variables.clear();
-  dumb_column_variables.clear();
   for (int j = 1; j <= n_column_variables; j++) {
     valid_column_variables.push_back(j);
   }
@@ -0,0 +1,54 @@
+#include "worker-pool.hpp"
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  start.notify_all();
+  for (auto &t : threads) {
+    t.join();
+  }
+}
+
+void WorkerPool::loop(int worker, long seen) {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    start.wait(lock, [&] { return stopping || generation != seen; });
+    if (stopping) {
+      return;
+    }
+    seen = generation;
+    if (worker >= n_active) {
+      continue;
+    }
+    lock.unlock();
+    (*task)(worker);
+    lock.lock();
+    if (--pending == 0) {
+      done.notify_one();
+    }
+  }
+}
+
+void WorkerPool::run(int n_workers, const std::function<void(int)> &f) {
+  if (n_workers <= 1) {
+    f(0);
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    while (threads.size() + 1 < n_workers) {
+      const int worker = threads.size() + 1;
+      threads.emplace_back(&WorkerPool::loop, this, worker, generation);
+    }
+    task = &f;
+    n_active = n_workers;
+    pending = n_workers - 1;
+    generation++;
+  }
+  start.notify_all();
+  f(0);
+  std::unique_lock<std::mutex> lock(mutex);
+  done.wait(lock, [this] { return pending == 0; });
+}